@@ -0,0 +1,75 @@
+"""Time the yearly tick for each mode combination.
+
+    python bench.py [--people 20000] [--years 60] [--repeat 3] [--threads 1]
+
+Prints the best wall time of `repeat` runs per combination of polygamy, mutation
+and metrics level (levels only where the build has them), in ms per simulated
+year. Every run starts from the same seed, so runs of one build are comparable
+across commits.
+"""
+import argparse
+import time
+
+import numpy as np
+from popsim import Environment, Population
+
+
+def make_environment(polygamy, mutation, people):
+    env = Environment()
+    env.resources = people / 3 if polygamy else 1.5 * people
+    env.incest_threshold = 80
+    env.polygamy = polygamy
+    env.marriage_probability = 0.9
+    env.conceiving_probability = 0.3 if polygamy else 0.8
+    env.age_of_consent = 18
+    env.mutation_bits = mutation
+    curve = np.zeros(128, dtype=np.float32)
+    curve[0:5] = 0.01
+    curve[5:18] = 0.002
+    curve[18:60] = 0.005
+    curve[60:90] = np.linspace(0.02, 0.2, 30)
+    curve[90:120] = np.linspace(0.2, 0.7, 30)
+    curve[120:128] = 0.99
+    env.dying_curve = curve
+    return env
+
+
+def run(env, people, years, threads, metrics_level):
+    pop = Population(seed=12345)
+    pop.set_environment(env)
+    if threads > 1 and hasattr(pop, "threads"):
+        pop.threads = threads
+    if metrics_level is not None:
+        pop.metrics_level = metrics_level
+    pop.initialize_random(people, 60)
+    start = time.perf_counter()
+    pop.step(years)
+    return time.perf_counter() - start, len(pop.persons())
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--people", type=int, default=20000)
+    parser.add_argument("--years", type=int, default=60)
+    parser.add_argument("--repeat", type=int, default=3)
+    parser.add_argument("--threads", type=int, default=1)
+    args = parser.parse_args()
+
+    levels = [None]
+    if hasattr(Population(), "metrics_level"):
+        levels = [0, 1, 2] if hasattr(Population(), "state_hash") else [0, 1]
+    level_names = {None: "-", 0: "off", 1: "history", 2: "hash"}
+
+    print(f"{'polygamy':>8} {'mutation':>8} {'metrics':>8} {'ms/year':>9} {'final N':>8}")
+    for polygamy in (False, True):
+        for mutation in (0, 3):
+            env = make_environment(polygamy, mutation, args.people)
+            for level in levels:
+                best, final = min(run(env, args.people, args.years, args.threads, level)
+                                  for _ in range(args.repeat))
+                print(f"{str(polygamy):>8} {mutation:>8} {level_names[level]:>8} "
+                      f"{1e3 * best / args.years:9.3f} {final:8d}")
+
+
+if __name__ == "__main__":
+    main()
@@ -1,19 +1,34 @@
 from setuptools import setup, Extension
 from Cython.Build import cythonize
 import numpy
+import sys
 
 ext = Extension(
     "popsim.popsim",
     sources=[
         "src/popsim/popsim.pyx",       # Cython
         "src/popsim/population.cpp",   # your C++ core
+        "src/popsim/population_io.cpp",
+        "src/popsim/column_codec.cpp",
+        "src/popsim/storage.cpp",
+        "src/popsim/history.cpp",
+        "src/popsim/snapshot.cpp",
+        "src/popsim/async_step.cpp",
+        "src/popsim/series.cpp",
+        "src/popsim/shared_export.cpp",
+        "src/popsim/draw_log.cpp",
+        "src/popsim/differential.cpp",
+        "src/popsim/perf_counters.cpp",
+        "src/popsim/tracer.cpp",
     ],
     include_dirs=[
         "src/popsim",
         numpy.get_include(),
     ],
     language="c++",
-    extra_compile_args=["-O3", "-std=c++17"],
+    extra_compile_args=["-O3", "-std=c++17", "-pthread"],
+    extra_link_args=["-pthread"],
+    libraries=["rt"] if sys.platform.startswith("linux") else [],  # shm_open on older glibc
 )
 
 setup(
@@ -1 +1,3 @@
-from .popsim import PyEnvironment as Environment, PersonView, PyPopulation as Population
\ No newline at end of file
+from .popsim import (PyEnvironment as Environment, PersonView, PyPopulation as Population,
+                     PySnapshotSeries as SnapshotSeries, PySharedPopulation as SharedPopulation,
+                     first_divergent_year)
\ No newline at end of file
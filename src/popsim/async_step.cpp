@@ -0,0 +1,89 @@
+#include "async_step.hpp"
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace popsim {
+
+#if defined(_WIN32)
+// No pipe for a selector loop to watch (and the default Proactor loop has no
+// add_reader): step_async is unavailable, everything else works
+AsyncStep::AsyncStep(Population &pop, uint32_t)
+    : pop_(pop), pipe_{-1, -1}, observer_id_(0), cancel_(false), years_done_(0), finished_(false) {
+    throw std::runtime_error("step_async is not supported on this platform");
+}
+
+AsyncStep::~AsyncStep() {}
+
+void AsyncStep::join() {}
+
+void AsyncStep::drain() {}
+#else
+
+AsyncStep::AsyncStep(Population &pop, uint32_t years)
+    : pop_(pop), pipe_{-1, -1}, observer_id_(0), cancel_(false), years_done_(0), finished_(false) {
+    if (::pipe(pipe_) != 0) throw std::runtime_error(std::string("cannot create pipe: ") + std::strerror(errno));
+    for (int fd : pipe_) {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    observer_id_ = pop_.add_observer(&AsyncStep::on_year, this);
+    worker_ = std::thread(&AsyncStep::run, this, years);
+}
+
+AsyncStep::~AsyncStep() {
+    cancel();
+    join();
+    for (int fd : pipe_) {
+        if (fd >= 0) ::close(fd);
+    }
+}
+
+void AsyncStep::join() {
+    if (!worker_.joinable()) return;
+    worker_.join();
+    pop_.remove_observer(observer_id_);
+}
+
+// Runs on the worker after each year
+bool AsyncStep::on_year(const Population &, void *self) {
+    AsyncStep *s = static_cast<AsyncStep *>(self);
+    s->years_done_.fetch_add(1, std::memory_order_release);
+    s->notify();
+    return !s->cancel_requested();
+}
+
+void AsyncStep::run(uint32_t years) {
+    try {
+        pop_.step(years);
+    } catch (const std::exception &e) {
+        error_ = e.what();
+        if (error_.empty()) error_ = "step failed";
+    } catch (...) {
+        error_ = "step failed";
+    }
+    finished_.store(true, std::memory_order_release);
+    notify();
+}
+
+// A full pipe already guarantees a wakeup, so a failed write is harmless
+void AsyncStep::notify() {
+    const char b = 1;
+    ssize_t r = ::write(pipe_[1], &b, 1);
+    (void)r;
+}
+
+void AsyncStep::drain() {
+    char buf[256];
+    while (::read(pipe_[0], buf, sizeof(buf)) > 0) {
+    }
+}
+
+#endif
+
+} // namespace popsim
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include "population.hpp"
+
+namespace popsim {
+
+// Population::step(years) on a worker thread, for event-loop driven callers.
+// After every year, and once more when the run ends, a byte is written to a
+// non-blocking pipe whose read end (notify_fd) an event loop can watch; the worker
+// never needs the caller's interpreter. cancel() is checked between years. The
+// population must not be touched by anyone else until finished(), and join() (or
+// the destructor, which cancels first) must run on the thread that constructed it.
+// POSIX only: elsewhere the constructor throws std::runtime_error.
+class AsyncStep {
+public:
+    // Starts the worker; throws std::runtime_error if the pipe cannot be created
+    AsyncStep(Population &pop, uint32_t years);
+    ~AsyncStep();
+    AsyncStep(const AsyncStep &) = delete;
+    AsyncStep &operator=(const AsyncStep &) = delete;
+
+    int notify_fd() const { return pipe_[0]; }
+    // Empty the pipe; call when notify_fd is readable
+    void drain();
+
+    void cancel() { cancel_.store(true, std::memory_order_relaxed); }
+    bool cancel_requested() const { return cancel_.load(std::memory_order_relaxed); }
+    uint32_t years_done() const { return years_done_.load(std::memory_order_acquire); }
+    bool finished() const { return finished_.load(std::memory_order_acquire); }
+    // Message of the exception that ended the run (empty if none); valid once finished
+    const std::string &error() const { return error_; }
+
+    // Wait for the worker and unregister from the population
+    void join();
+
+private:
+    static bool on_year(const Population &pop, void *self);
+    void run(uint32_t years);
+    void notify();
+
+    Population &pop_;
+    int pipe_[2];
+    uint64_t observer_id_;
+    std::atomic<bool> cancel_;
+    std::atomic<uint32_t> years_done_;
+    std::atomic<bool> finished_;
+    std::string error_;
+    std::thread worker_;
+};
+
+} // namespace popsim
@@ -0,0 +1,294 @@
+#include "column_codec.hpp"
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include "parallel.hpp"
+
+namespace popsim {
+
+namespace {
+
+uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+void store_le(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; ++i) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+uint64_t load_le(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+unsigned bit_width(uint64_t v) {
+    unsigned w = 0;
+    while (v) {
+        ++w;
+        v >>= 1;
+    }
+    return w;
+}
+
+class ByteWriter {
+public:
+    explicit ByteWriter(std::vector<uint8_t> &out) : out_(out), bits_(0), nbits_(0) {}
+    void byte(uint8_t b) { out_.push_back(b); }
+    // Room for `bytes` more bytes, filled by the caller
+    uint8_t *extend(std::size_t bytes) {
+        const std::size_t at = out_.size();
+        out_.resize(at + bytes);
+        return out_.data() + at;
+    }
+    void varint(uint64_t v) {
+        while (v >= 0x80) {
+            out_.push_back((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        out_.push_back((uint8_t)v);
+    }
+    // Bit-packed values, LSB first; flush_bits() pads to a byte
+    void bits(uint64_t v, unsigned width) {
+        for (unsigned done = 0; done < width;) {
+            const unsigned take = std::min(width - done, 8u);
+            bits_ |= ((v >> done) & ((uint64_t(1) << take) - 1)) << nbits_;
+            nbits_ += take;
+            done += take;
+            while (nbits_ >= 8) {
+                out_.push_back((uint8_t)bits_);
+                bits_ >>= 8;
+                nbits_ -= 8;
+            }
+        }
+    }
+    void flush_bits() {
+        if (nbits_) out_.push_back((uint8_t)bits_);
+        bits_ = 0;
+        nbits_ = 0;
+    }
+
+private:
+    std::vector<uint8_t> &out_;
+    uint64_t bits_;
+    unsigned nbits_;
+};
+
+class ByteReader {
+public:
+    ByteReader(const uint8_t *p, const uint8_t *end) : p_(p), end_(end), bits_(0), nbits_(0) {}
+    uint8_t byte() {
+        need(1);
+        return *p_++;
+    }
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const uint8_t b = byte();
+            v |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        throw std::runtime_error("corrupt varint in checkpoint");
+    }
+    uint64_t bits(unsigned width) {
+        uint64_t v = 0;
+        for (unsigned done = 0; done < width;) {
+            if (nbits_ == 0) {
+                bits_ = byte();
+                nbits_ = 8;
+            }
+            const unsigned take = std::min(width - done, nbits_);
+            v |= (bits_ & ((uint64_t(1) << take) - 1)) << done;
+            bits_ >>= take;
+            nbits_ -= take;
+            done += take;
+        }
+        return v;
+    }
+    const uint8_t *take(std::size_t bytes) {
+        need((std::ptrdiff_t)bytes);
+        const uint8_t *at = p_;
+        p_ += bytes;
+        return at;
+    }
+    void align() { nbits_ = 0; }
+    bool done() const { return p_ == end_; }
+
+private:
+    void need(std::ptrdiff_t n) {
+        if (end_ - p_ < n) throw std::runtime_error("truncated checkpoint chunk");
+    }
+    const uint8_t *p_;
+    const uint8_t *end_;
+    uint64_t bits_;
+    unsigned nbits_;
+};
+
+void encode_chunk(const Person *people, std::size_t n, int32_t year, std::vector<uint8_t> &out) {
+    ByteWriter w(out);
+    uint64_t prev = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        w.varint(zigzag((int64_t)(people[i].id - prev)));
+        prev = people[i].id;
+    }
+    uint64_t max_age = 0, max_gender = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        max_age = std::max<uint64_t>(max_age, (uint32_t)(year - people[i].birth_year));
+        max_gender = std::max<uint64_t>(max_gender, people[i].gender);
+    }
+    const unsigned age_width = bit_width(max_age), gender_width = bit_width(max_gender);
+    w.byte((uint8_t)age_width);
+    w.byte((uint8_t)gender_width);
+    for (std::size_t i = 0; i < n; ++i) w.bits((uint32_t)(year - people[i].birth_year), age_width);
+    w.flush_bits();
+    for (std::size_t i = 0; i < n; ++i) w.bits(people[i].gender, gender_width);
+    w.flush_bits();
+    for (std::size_t i = 0; i < n; ++i) w.bits(people[i].marital & 1ull, 1);
+    w.flush_bits();
+    for (std::size_t i = 0; i < n; ++i) {
+        if (people[i].married()) w.varint(zigzag((int64_t)(people[i].partner_id() - people[i].id)));
+    }
+    uint8_t *g = w.extend(n * 16);
+    for (std::size_t i = 0; i < n; ++i, g += 16) {
+        store_le(g, people[i].g0);
+        store_le(g + 8, people[i].g1);
+    }
+}
+
+void decode_chunk(const uint8_t *p, const uint8_t *end, Person *people, std::size_t n, int32_t year) {
+    ByteReader r(p, end);
+    uint64_t prev = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        people[i] = Person{};
+        people[i].id = prev += (uint64_t)unzigzag(r.varint());
+    }
+    const unsigned age_width = r.byte(), gender_width = r.byte();
+    if (age_width > 32 || gender_width > 32) throw std::runtime_error("corrupt checkpoint chunk");
+    for (std::size_t i = 0; i < n; ++i) people[i].birth_year = year - (int32_t)(uint32_t)r.bits(age_width);
+    r.align();
+    for (std::size_t i = 0; i < n; ++i) people[i].gender = (uint32_t)r.bits(gender_width);
+    r.align();
+    for (std::size_t i = 0; i < n; ++i) people[i].marital = r.bits(1);
+    r.align();
+    for (std::size_t i = 0; i < n; ++i) {
+        if (people[i].marital) people[i].marital |= (people[i].id + (uint64_t)unzigzag(r.varint())) << 1;
+    }
+    const uint8_t *g = r.take(n * 16);
+    for (std::size_t i = 0; i < n; ++i, g += 16) {
+        people[i].g0 = load_le(g);
+        people[i].g1 = load_le(g + 8);
+    }
+    if (!r.done()) throw std::runtime_error("corrupt checkpoint chunk");
+}
+
+template <class T>
+void put(std::ostream &out, const T &v) {
+    out.write(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+template <class T>
+void get(std::istream &in, T &v) {
+    in.read(reinterpret_cast<char *>(&v), sizeof(T));
+    if (!in) throw std::runtime_error("truncated checkpoint");
+}
+
+void put_bytes(std::ostream &out, const std::vector<uint8_t> &b) {
+    put(out, (uint64_t)b.size());
+    out.write(reinterpret_cast<const char *>(b.data()), (std::streamsize)b.size());
+}
+
+std::vector<uint8_t> get_bytes(std::istream &in) {
+    uint64_t n;
+    get(in, n);
+    std::vector<uint8_t> b((std::size_t)n);
+    in.read(reinterpret_cast<char *>(b.data()), (std::streamsize)n);
+    if (!in) throw std::runtime_error("truncated checkpoint");
+    return b;
+}
+
+} // namespace
+
+void write_people_columns(std::ostream &out, const PersonVector &people, int32_t year, unsigned threads) {
+    const std::size_t n = people.size();
+    const std::size_t chunks = (n + kCodecChunk - 1) / kCodecChunk;
+    std::vector<std::vector<uint8_t>> encoded(chunks);
+    parallel_for(chunks, threads, [&](std::size_t c) {
+        const std::size_t lo = c * kCodecChunk, hi = std::min(n, lo + kCodecChunk);
+        encoded[c].reserve((hi - lo) * 20);
+        encode_chunk(people.data() + lo, hi - lo, year, encoded[c]);
+    });
+    put(out, (uint64_t)n);
+    put(out, (uint32_t)chunks);
+    for (const auto &e : encoded) put(out, (uint64_t)e.size());
+    for (const auto &e : encoded) out.write(reinterpret_cast<const char *>(e.data()), (std::streamsize)e.size());
+}
+
+void read_people_columns(std::istream &in, PersonVector &people, int32_t year, unsigned threads) {
+    uint64_t n;
+    uint32_t chunks;
+    get(in, n);
+    get(in, chunks);
+    if (chunks != (n + kCodecChunk - 1) / kCodecChunk) throw std::runtime_error("corrupt checkpoint chunk table");
+    std::vector<uint64_t> sizes(chunks);
+    for (auto &s : sizes) get(in, s);
+    std::vector<std::vector<uint8_t>> encoded(chunks);
+    for (uint32_t c = 0; c < chunks; ++c) {
+        encoded[c].resize((std::size_t)sizes[c]);
+        in.read(reinterpret_cast<char *>(encoded[c].data()), (std::streamsize)sizes[c]);
+        if (!in) throw std::runtime_error("truncated checkpoint");
+    }
+    people.resize((std::size_t)n);
+    // decode errors surface on the calling thread
+    std::vector<std::string> errors(chunks);
+    parallel_for(chunks, threads, [&](std::size_t c) {
+        const std::size_t lo = c * kCodecChunk, hi = std::min((std::size_t)n, lo + kCodecChunk);
+        try {
+            decode_chunk(encoded[c].data(), encoded[c].data() + encoded[c].size(), people.data() + lo, hi - lo, year);
+        } catch (const std::exception &e) {
+            errors[c] = e.what();
+        }
+    });
+    for (const auto &e : errors) {
+        if (!e.empty()) throw std::runtime_error(e);
+    }
+}
+
+void write_couples_columns(std::ostream &out, const std::vector<Couple> &couples, std::size_t people, int32_t year) {
+    std::vector<uint8_t> b;
+    ByteWriter w(b);
+    const unsigned width = bit_width(people);
+    w.byte((uint8_t)width);
+    for (const Couple &c : couples) {
+        w.bits(c.mother, width);
+        w.bits(c.father, width);
+    }
+    w.flush_bits();
+    for (const Couple &c : couples) w.varint(zigzag((int64_t)year - c.married_year));
+    put(out, (uint64_t)couples.size());
+    put_bytes(out, b);
+}
+
+void read_couples_columns(std::istream &in, std::vector<Couple> &couples, const PersonVector &people, int32_t year) {
+    uint64_t n;
+    get(in, n);
+    const std::vector<uint8_t> b = get_bytes(in);
+    ByteReader r(b.data(), b.data() + b.size());
+    const unsigned width = r.byte();
+    if (width > 32) throw std::runtime_error("corrupt checkpoint couples");
+    couples.resize((std::size_t)n);
+    for (Couple &c : couples) {
+        c.mother = (uint32_t)r.bits(width);
+        c.father = (uint32_t)r.bits(width);
+        if (c.mother >= people.size() || c.father >= people.size()) {
+            throw std::runtime_error("corrupt checkpoint couples");
+        }
+        c.mother_birth_year = people[c.mother].birth_year;
+        c.father_birth_year = people[c.father].birth_year;
+    }
+    r.align();
+    for (Couple &c : couples) c.married_year = (int32_t)((int64_t)year - unzigzag(r.varint()));
+    if (!r.done()) throw std::runtime_error("corrupt checkpoint couples");
+}
+
+} // namespace popsim
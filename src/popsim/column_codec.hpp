@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+#include "population.hpp"
+
+namespace popsim {
+
+// Column encodings of the population arrays for compressed checkpoints.
+//
+// People are cut into chunks of kCodecChunk persons, encoded and decoded in
+// parallel, and written as: u64 count, u32 chunks, u64 bytes per chunk, chunks.
+// Within a chunk, each column is stored on its own:
+//   id       zigzag varint gap from the previous id (1 byte for ascending ids)
+//   age      year - birth_year, bit-packed at the chunk's widest value
+//   gender   bit-packed likewise (1 bit for 0/1)
+//   marital  1 bit married flag, then zigzag varint (partner - id) per married person
+//   genomes  raw little-endian g0, g1 (recombined random bits do not compress)
+// Unmarried persons must have marital == 0, as the model maintains.
+//
+// Couples: u64 count, slot width, bit-packed mother and father slots, then zigzag
+// varint (year - married_year); cached birth years are rebuilt from the people.
+// All functions throw std::runtime_error on short or malformed input.
+constexpr std::size_t kCodecChunk = std::size_t(1) << 16;
+
+void write_people_columns(std::ostream &out, const PersonVector &people, int32_t year, unsigned threads);
+void read_people_columns(std::istream &in, PersonVector &people, int32_t year, unsigned threads);
+void write_couples_columns(std::ostream &out, const std::vector<Couple> &couples, std::size_t people, int32_t year);
+void read_couples_columns(std::istream &in, std::vector<Couple> &couples, const PersonVector &people, int32_t year);
+
+} // namespace popsim
@@ -0,0 +1,149 @@
+#include "differential.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace popsim {
+
+namespace {
+
+struct RunSummary {
+    std::vector<uint64_t> hashes; // exact mode only
+    double final_size;
+    double final_mean_age;
+    double births;
+    double deaths;
+};
+
+RunSummary run_once(const Environment &env, const DifferentialOptions &opt, uint64_t seed,
+                    const std::function<void(Population &)> *configure) {
+    Population pop(seed);
+    if (configure) (*configure)(pop);
+    pop.set_environment(env);
+    pop.set_metrics_level(opt.exact ? MetricsLevel::Hash : MetricsLevel::History);
+    pop.initialize_random(opt.population);
+    pop.step(opt.years);
+
+    RunSummary s;
+    s.hashes = pop.state_hash_history();
+    s.final_size = (double)pop.persons().size();
+    s.final_mean_age = pop.mean_age_history().empty() ? 0.0 : pop.mean_age_history().back();
+    s.births = 0.0;
+    s.deaths = 0.0;
+    for (size_t b : pop.births_history()) s.births += (double)b;
+    for (size_t d : pop.deaths_history()) s.deaths += (double)d;
+    return s;
+}
+
+} // namespace
+
+Environment random_environment(std::mt19937_64 &rng, std::size_t population) {
+    std::uniform_real_distribution<double> U(0.0, 1.0);
+    Environment env;
+    env.polygamy = U(rng) < 0.25;
+    // polygamy pressure grows with crowding, so keep it below capacity there
+    env.resources = (double)population * (env.polygamy ? 0.3 + 0.5 * U(rng) : 1.0 + 2.0 * U(rng));
+    env.incest_threshold = 64u + (uint32_t)(36.0 * U(rng));
+    env.marriage_probability = 0.1 + 0.8 * U(rng);
+    env.conceiving_probability = 0.1 + 0.5 * U(rng);
+    env.age_of_consent = 14u + (uint32_t)(7.0 * U(rng));
+    env.mutation_bits = U(rng) < 0.5 ? 0u : 1u + (uint32_t)(4.0 * U(rng));
+    env.female_fertility_min = env.age_of_consent;
+    env.female_fertility_max = 38u + (uint32_t)(10.0 * U(rng));
+    env.male_fertility_min = env.age_of_consent;
+    env.male_fertility_max = 50u + (uint32_t)(25.0 * U(rng));
+    // bathtub: infant mortality, a low adult floor, then Gompertz growth
+    const double infant = 0.005 + 0.03 * U(rng);
+    const double floor = 0.001 + 0.005 * U(rng);
+    const double onset = 40.0 + 20.0 * U(rng);
+    const double growth = 0.06 + 0.06 * U(rng);
+    for (int a = 0; a < 128; ++a) {
+        double q = floor + infant * std::exp(-(double)a / 2.0) + 0.01 * std::exp(growth * ((double)a - onset));
+        env.dying_curve[a] = (float)std::min(q, 1.0);
+    }
+    return env;
+}
+
+double ks_statistic(std::vector<double> a, std::vector<double> b) {
+    if (a.empty() || b.empty()) return 0.0;
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    const double na = (double)a.size(), nb = (double)b.size();
+    size_t i = 0, j = 0;
+    double d = 0.0;
+    while (i < a.size() && j < b.size()) {
+        double x = std::min(a[i], b[j]);
+        while (i < a.size() && a[i] <= x) ++i; // step over ties on both sides
+        while (j < b.size() && b[j] <= x) ++j;
+        d = std::max(d, std::fabs((double)i / na - (double)j / nb));
+    }
+    return d;
+}
+
+double ks_p_value(double d, std::size_t n, std::size_t m) {
+    if (n == 0 || m == 0) return 1.0;
+    const double ne = (double)n * (double)m / (double)(n + m);
+    const double sq = std::sqrt(ne);
+    const double lambda = (sq + 0.12 + 0.11 / sq) * d;
+    if (lambda < 0.2) return 1.0;
+    // Kolmogorov distribution tail: 2 * sum (-1)^(k-1) exp(-2 k^2 lambda^2)
+    double sum = 0.0, sign = 1.0;
+    for (int k = 1; k <= 100; ++k) {
+        double term = sign * std::exp(-2.0 * k * k * lambda * lambda);
+        sum += term;
+        if (std::fabs(term) < 1e-12) break;
+        sign = -sign;
+    }
+    return std::clamp(2.0 * sum, 0.0, 1.0);
+}
+
+DifferentialReport run_differential(const std::function<void(Population &)> &configure,
+                                    const DifferentialOptions &options) {
+    DifferentialReport report;
+    std::mt19937_64 rng(options.seed);
+    const double alpha = options.alpha / (4.0 * (double)std::max(1u, options.environments));
+    static const char *const kMetricNames[4] = {"final size", "final mean age", "births", "deaths"};
+
+    for (uint32_t e = 0; e < options.environments && report.passed; ++e) {
+        Environment env = random_environment(rng, options.population);
+        std::vector<double> ref[4], cand[4];
+        for (uint32_t s = 0; s < options.seeds; ++s) {
+            uint64_t seed = rng();
+            RunSummary a = run_once(env, options, seed, nullptr);
+            RunSummary b = run_once(env, options, seed, &configure);
+            if (options.exact) {
+                size_t n = std::min(a.hashes.size(), b.hashes.size());
+                size_t y = 0;
+                while (y < n && a.hashes[y] == b.hashes[y]) ++y;
+                if (y < n || a.hashes.size() != b.hashes.size()) {
+                    report.passed = false;
+                    report.divergent_year = (int32_t)y + 1;
+                    report.failure = "environment " + std::to_string(e) + ", seed " + std::to_string(seed) +
+                                     ": state differs from year " + std::to_string(y + 1);
+                    break;
+                }
+                continue;
+            }
+            const double ra[4] = {a.final_size, a.final_mean_age, a.births, a.deaths};
+            const double rb[4] = {b.final_size, b.final_mean_age, b.births, b.deaths};
+            for (int k = 0; k < 4; ++k) {
+                ref[k].push_back(ra[k]);
+                cand[k].push_back(rb[k]);
+            }
+        }
+        if (!options.exact) {
+            for (int k = 0; k < 4 && report.passed; ++k) {
+                double p = ks_p_value(ks_statistic(ref[k], cand[k]), ref[k].size(), cand[k].size());
+                report.min_p_value = std::min(report.min_p_value, p);
+                if (p < alpha) {
+                    report.passed = false;
+                    report.failure = "environment " + std::to_string(e) + ": " + kMetricNames[k] +
+                                     " distributions differ (KS p = " + std::to_string(p) + ")";
+                }
+            }
+        }
+        report.environments_run = e + 1;
+    }
+    return report;
+}
+
+} // namespace popsim
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+#include "population.hpp"
+
+namespace popsim {
+
+// Differential checking of an engine variant against the reference Population.
+//
+// The candidate is a Population adjusted by `configure` (threads, household
+// reordering, huge pages, ...). For every randomized Environment the reference
+// and the candidate are run from the same seeds. Variants that promise exact
+// determinism are compared year by year through state hashes; others are compared
+// statistically, with two-sample Kolmogorov-Smirnov tests on per-seed summaries
+// (final size, final mean age, total births, total deaths). Only per-seed
+// summaries are tested: people within one run are not independent samples.
+struct DifferentialOptions {
+    uint32_t environments = 8;    // randomized environments to try
+    uint32_t seeds = 24;          // seeds per environment (statistical mode)
+    uint32_t years = 40;          // years simulated per run
+    std::size_t population = 2000; // initial size
+    uint64_t seed = 1;            // drives environment generation and run seeds
+    bool exact = true;            // candidate promises bit-identical results
+    double alpha = 1e-3;          // family-wise significance level (Bonferroni-split)
+};
+
+struct DifferentialReport {
+    bool passed = true;
+    uint32_t environments_run = 0;
+    std::string failure;          // first failure, empty when passed
+    int32_t divergent_year = -1;  // exact mode: first year whose state hashes differ
+    double min_p_value = 1.0;     // statistical mode: smallest KS p-value seen
+};
+
+// A plausible random Environment: bathtub-shaped mortality, monogamy or polygamy
+// with resources scaled to `population`
+Environment random_environment(std::mt19937_64 &rng, std::size_t population);
+
+// Two-sample Kolmogorov-Smirnov statistic and asymptotic p-value
+double ks_statistic(std::vector<double> a, std::vector<double> b);
+double ks_p_value(double d, std::size_t n, std::size_t m);
+
+DifferentialReport run_differential(const std::function<void(Population &)> &configure,
+                                    const DifferentialOptions &options = DifferentialOptions());
+
+} // namespace popsim
@@ -0,0 +1,84 @@
+#include "draw_log.hpp"
+#include <cstring>
+#include <stdexcept>
+
+namespace popsim {
+
+static const char kDrawLogMagic[8] = {'P', 'S', 'D', 'R', 'A', 'W', '0', '1'};
+static constexpr std::size_t kRecordBytes = 18;
+static constexpr std::size_t kBufferBytes = std::size_t(1) << 20;
+
+static void put_u64(unsigned char *out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) out[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint64_t get_u64(const unsigned char *in) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v |= (uint64_t)in[i] << (8 * i);
+    return v;
+}
+
+void DrawLog::open_record(const std::string &path) {
+    close();
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) throw std::runtime_error("cannot open draw log for writing: " + path);
+    std::setvbuf(file_, nullptr, _IOFBF, kBufferBytes);
+    path_ = path;
+    mode_ = DrawMode::Record;
+    write_failed_ = std::fwrite(kDrawLogMagic, 1, sizeof(kDrawLogMagic), file_) != sizeof(kDrawLogMagic);
+    flush();
+}
+
+void DrawLog::open_replay(const std::string &path) {
+    close();
+    file_ = std::fopen(path.c_str(), "rb");
+    if (!file_) throw std::runtime_error("cannot open draw log for reading: " + path);
+    std::setvbuf(file_, nullptr, _IOFBF, kBufferBytes);
+    path_ = path;
+    char magic[sizeof(kDrawLogMagic)];
+    if (std::fread(magic, 1, sizeof(magic), file_) != sizeof(magic) ||
+        std::memcmp(magic, kDrawLogMagic, sizeof(magic)) != 0) {
+        close();
+        throw std::runtime_error("not a popsim draw log: " + path);
+    }
+    mode_ = DrawMode::Replay;
+}
+
+void DrawLog::close() {
+    const bool failed = file_ && (std::fclose(file_) != 0 || write_failed_) && mode_ == DrawMode::Record;
+    file_ = nullptr;
+    mode_ = DrawMode::Off;
+    count_ = 0;
+    write_failed_ = false;
+    if (failed) throw std::runtime_error("failed writing draw log: " + path_);
+}
+
+void DrawLog::flush() {
+    if (mode_ != DrawMode::Record) return;
+    // a recording that lost records is useless for replay, so it is closed here
+    if (std::fflush(file_) != 0) write_failed_ = true;
+    if (write_failed_) close();
+}
+
+void DrawLog::write(const DrawRecord &r) {
+    unsigned char buf[kRecordBytes];
+    buf[0] = r.phase;
+    buf[1] = r.outcome;
+    put_u64(buf + 2, r.person);
+    put_u64(buf + 10, r.value);
+    if (std::fwrite(buf, 1, kRecordBytes, file_) != kRecordBytes) write_failed_ = true;
+    ++count_;
+}
+
+bool DrawLog::read(DrawRecord &r) {
+    unsigned char buf[kRecordBytes];
+    if (std::fread(buf, 1, kRecordBytes, file_) != kRecordBytes) return false;
+    r.phase = buf[0];
+    r.outcome = buf[1];
+    r.person = get_u64(buf + 2);
+    r.value = get_u64(buf + 10);
+    ++count_;
+    return true;
+}
+
+} // namespace popsim
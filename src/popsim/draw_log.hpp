@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace popsim {
+
+// What a logged random draw was used for
+enum class DrawPhase : uint8_t {
+    Init = 0,       // initialize_random
+    Death = 1,      // yearly mortality decision
+    Shuffle = 2,    // seed of a candidate-pool shuffle
+    Marriage = 3,   // marriage decision for a candidate pair (person = wife)
+    Conception = 4, // conception decision (person = mother)
+    Partner = 5,    // polygamy: father pick (person = mother)
+    Birth = 6,      // genome recombination masks and gender (person = child)
+    Mutation = 7,   // mutation bit positions (person = child)
+};
+
+enum class DrawMode : uint8_t { Off = 0, Record = 1, Replay = 2 };
+
+// One random decision. outcome is 1/0 for yes/no decisions, kNoOutcome for raw draws.
+struct DrawRecord {
+    static constexpr uint8_t kNoOutcome = 0xFF;
+    uint8_t phase;
+    uint8_t outcome;
+    uint64_t person; // id the draw is about (0 when none)
+    uint64_t value;  // raw 64-bit engine output
+};
+
+// First difference found while replaying
+struct DrawMismatch {
+    bool found;
+    uint64_t index;       // position of the draw in the log
+    int32_t year;         // Population::year() when it happened
+    DrawRecord expected;  // from the log (phase = 0xFF: log exhausted)
+    DrawRecord actual;    // what the engine asked for / decided
+};
+
+// Binary draw log: "PSDRAW01" followed by packed 18-byte little-endian records
+// (phase, outcome, person, value). Writes and reads are buffered; a recording is
+// flushed once per simulated year, and a failed write is reported by the next flush().
+class DrawLog {
+public:
+    DrawLog() : file_(nullptr), mode_(DrawMode::Off), count_(0), write_failed_(false) {}
+    ~DrawLog() {
+        if (file_) std::fclose(file_);
+    }
+    DrawLog(const DrawLog &) = delete;
+    DrawLog &operator=(const DrawLog &) = delete;
+
+    // Throw std::runtime_error when the file cannot be opened or is not a draw log
+    void open_record(const std::string &path);
+    void open_replay(const std::string &path);
+    // Throws std::runtime_error if a recording could not be written out completely
+    void close();
+    void flush();
+
+    DrawMode mode() const { return mode_; }
+    uint64_t count() const { return count_; } // records written / read so far
+
+    void write(const DrawRecord &r);
+    bool read(DrawRecord &r); // false at end of log
+
+private:
+    std::FILE *file_;
+    std::string path_;
+    DrawMode mode_;
+    uint64_t count_;
+    bool write_failed_;
+};
+
+} // namespace popsim
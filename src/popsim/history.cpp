@@ -0,0 +1,91 @@
+#include "history.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace popsim {
+
+template <class T>
+static MetricSummary summarize(const T *v, std::size_t n) {
+    MetricSummary s{(double)v[0], (double)v[0], 0.0};
+    double sum = 0.0;
+    for (std::size_t i = 0; i < n; ++i) {
+        const double x = (double)v[i];
+        s.min = std::min(s.min, x);
+        s.max = std::max(s.max, x);
+        sum += x;
+    }
+    s.mean = sum / (double)n;
+    return s;
+}
+
+HistorySummary summarize_history(uint64_t first, const double *mean_age, const std::size_t *population,
+                                 const std::size_t *births, const std::size_t *deaths, std::size_t n) {
+    HistorySummary s;
+    s.first = first;
+    s.count = n;
+    s.mean_age = summarize(mean_age, n);
+    s.population = summarize(population, n);
+    s.births = summarize(births, n);
+    s.deaths = summarize(deaths, n);
+    return s;
+}
+
+// Merge b (which follows a) into a
+static void merge(MetricSummary &a, uint64_t a_count, const MetricSummary &b, uint64_t b_count) {
+    a.min = std::min(a.min, b.min);
+    a.max = std::max(a.max, b.max);
+    a.mean = (a.mean * (double)a_count + b.mean * (double)b_count) / (double)(a_count + b_count);
+}
+
+static void merge(HistorySummary &a, const HistorySummary &b) {
+    merge(a.mean_age, a.count, b.mean_age, b.count);
+    merge(a.population, a.count, b.population, b.count);
+    merge(a.births, a.count, b.births, b.count);
+    merge(a.deaths, a.count, b.deaths, b.count);
+    a.count += b.count;
+}
+
+void HistoryLevels::configure(const HistoryRetention &retention) {
+    retention_ = retention;
+    retention_.factor = std::max(retention_.factor, 2u);
+    retention_.buckets = std::max(retention_.buckets, retention_.factor);
+    retention_.levels = std::max(retention_.levels, 1u);
+    clear();
+}
+
+void HistoryLevels::clear() {
+    levels_.clear();
+    dropped_ = 0;
+}
+
+void HistoryLevels::push(std::size_t level, const HistorySummary &s) {
+    if (levels_.size() <= level) {
+        levels_.resize(level + 1);
+        levels_[level].reserve(retention_.buckets + 1);
+    }
+    std::vector<HistorySummary> &buckets = levels_[level];
+    buckets.push_back(s);
+    if (buckets.size() <= retention_.buckets) return;
+    if (level + 1 == retention_.levels) {
+        dropped_ += buckets.front().count;
+        buckets.erase(buckets.begin());
+        return;
+    }
+    HistorySummary merged = buckets[0];
+    for (uint32_t i = 1; i < retention_.factor; ++i) merge(merged, buckets[i]);
+    buckets.erase(buckets.begin(), buckets.begin() + retention_.factor);
+    push(level + 1, merged);
+}
+
+void HistoryLevels::restore(std::vector<std::vector<HistorySummary>> levels, uint64_t dropped) {
+    levels_ = std::move(levels);
+    dropped_ = dropped;
+}
+
+std::size_t HistoryLevels::memory_bytes() const {
+    std::size_t bytes = levels_.capacity() * sizeof(levels_[0]);
+    for (const auto &l : levels_) bytes += l.capacity() * sizeof(HistorySummary);
+    return bytes;
+}
+
+} // namespace popsim
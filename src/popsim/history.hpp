@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace popsim {
+
+// Min, max and mean of one metric over a run of consecutive history entries
+struct MetricSummary {
+    double min;
+    double max;
+    double mean;
+};
+
+// One downsampled bucket: history entries [first, first + count), where entry 0 is
+// the first year recorded since initialize_random
+struct HistorySummary {
+    uint64_t first;
+    uint64_t count;
+    MetricSummary mean_age;
+    MetricSummary population;
+    MetricSummary births;
+    MetricSummary deaths;
+};
+
+// Retention of the per-year metric histories. recent == 0 (default) keeps every
+// year. Otherwise at least the last `recent` years stay at full resolution and
+// older ones are folded into summary levels: a level-0 bucket covers `factor`
+// years and a level-i bucket factor^(i+1). Each level keeps up to `buckets`
+// buckets and merges its oldest `factor` into the next level when full; the top
+// level discards its oldest, so memory stays bounded however long the run.
+struct HistoryRetention {
+    uint32_t recent = 0;
+    uint32_t factor = 4;
+    uint32_t buckets = 64;
+    uint32_t levels = 8;
+};
+
+// Summary of n consecutive entries starting at `first`
+HistorySummary summarize_history(uint64_t first, const double *mean_age, const std::size_t *population,
+                                 const std::size_t *births, const std::size_t *deaths, std::size_t n);
+
+// Summary levels of a bounded history; level(0) is the finest and most recent
+class HistoryLevels {
+public:
+    HistoryLevels() : dropped_(0) {}
+
+    // Set the retention shape; discards all buckets
+    void configure(const HistoryRetention &retention);
+    void clear();
+    // Append the next level-0 bucket (chronological order)
+    void add(const HistorySummary &s) { push(0, s); }
+
+    const HistoryRetention &retention() const { return retention_; }
+    std::size_t level_count() const { return levels_.size(); }
+    const std::vector<HistorySummary> &level(std::size_t i) const { return levels_[i]; }
+    // Entries discarded off the top level
+    uint64_t dropped() const { return dropped_; }
+    std::size_t memory_bytes() const;
+    // Restore buckets and dropped count (checkpoints); levels must fit the retention
+    void restore(std::vector<std::vector<HistorySummary>> levels, uint64_t dropped);
+
+private:
+    void push(std::size_t level, const HistorySummary &s);
+
+    HistoryRetention retention_;
+    std::vector<std::vector<HistorySummary>> levels_;
+    uint64_t dropped_;
+};
+
+} // namespace popsim
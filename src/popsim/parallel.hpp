@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "tracer.hpp"
+
+namespace popsim {
+
+// Run f(i) for i in [0, n) on up to `threads` threads (the caller included).
+// Work is dealt out in contiguous ranges; callers must make f's effects
+// independent of which thread runs which i so results never depend on
+// the thread count. With a tracer, each worker's range is recorded as `name`
+// on that worker's slot.
+template <class F>
+void parallel_for(std::size_t n, unsigned threads, F &&f, Tracer *tracer = nullptr, const char *name = "parallel") {
+    if (threads <= 1 || n <= 1) {
+        TraceScope scope(tracer, 0, name);
+        for (std::size_t i = 0; i < n; ++i) f(i);
+        return;
+    }
+    const std::size_t workers = threads < n ? threads : n;
+    if (tracer) tracer->reserve_workers(workers);
+    auto run = [&](std::size_t t) {
+        TraceScope scope(tracer, t, name);
+        std::size_t lo = n * t / workers, hi = n * (t + 1) / workers;
+        for (std::size_t i = lo; i < hi; ++i) f(i);
+    };
+    std::vector<std::thread> pool;
+    pool.reserve(workers - 1);
+    for (std::size_t t = 1; t < workers; ++t) pool.emplace_back(run, t);
+    run(0);
+    for (auto &th : pool) th.join();
+}
+
+// SplitMix64: tiny counter-friendly generator used to derive independent,
+// seed-determined streams for parallel work
+struct SplitMix64 {
+    uint64_t state;
+    explicit SplitMix64(uint64_t seed) : state(seed) {}
+    uint64_t operator()() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    // Unbiased integer in [0, bound), bound > 0
+    uint64_t below(uint64_t bound) {
+        const uint64_t reject = (0ull - bound) % bound; // 2^64 mod bound
+        uint64_t r;
+        do { r = (*this)(); } while (r < reject);
+        return r % bound;
+    }
+};
+
+// Seed of stream `stream` derived from `seed`
+inline uint64_t derive_seed(uint64_t seed, uint64_t stream) {
+    SplitMix64 sm(seed ^ (stream * 0xD1B54A32D192ED03ull));
+    return sm();
+}
+
+} // namespace popsim
@@ -0,0 +1,115 @@
+#include "perf_counters.hpp"
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace popsim {
+
+PerfCounters::PerfCounters() : leader_(-1), thread_(0) {
+    for (int e = 0; e < kEvents; ++e) fds_[e] = -1;
+    reset();
+}
+
+PerfCounters::~PerfCounters() { close(); }
+
+#if defined(__linux__)
+static long current_thread() { return (long)syscall(SYS_gettid); }
+
+static int open_event(uint32_t type, uint64_t config, int group_fd) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1; // allowed at perf_event_paranoid <= 2
+    attr.exclude_hv = 1;
+    attr.inherit = 1;        // include parallel_for workers (folded in when they exit)
+    // the group is scheduled as a unit; each member reads its value with the times
+    // the group was enabled and running, so multiplexed counts can be scaled (a
+    // PERF_FORMAT_GROUP read is not combined with inherit on older kernels)
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // this thread, any CPU
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif
+
+bool PerfCounters::open() {
+    close();
+#if defined(__linux__)
+    const uint64_t llc_read_miss = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    const uint64_t dtlb_read_miss = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    const uint32_t types[kEvents] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE,
+                                     PERF_TYPE_HW_CACHE};
+    const uint64_t configs[kEvents] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, llc_read_miss,
+                                       PERF_COUNT_HW_BRANCH_MISSES, dtlb_read_miss};
+    // the first event that opens leads the group; the rest join it in order
+    for (int e = 0; e < kEvents; ++e) {
+        fds_[e] = open_event(types[e], configs[e], leader_);
+        if (fds_[e] >= 0 && leader_ < 0) leader_ = fds_[e];
+    }
+    thread_ = current_thread();
+#endif
+    return leader_ >= 0;
+}
+
+void PerfCounters::close() {
+#if defined(__linux__)
+    for (int e = 0; e < kEvents; ++e) {
+        if (fds_[e] >= 0) ::close(fds_[e]);
+        fds_[e] = -1;
+    }
+#endif
+    leader_ = -1;
+    thread_ = 0;
+}
+
+void PerfCounters::follow_calling_thread() {
+#if defined(__linux__)
+    if (thread_ != current_thread()) open();
+#endif
+}
+
+void PerfCounters::read_all(uint64_t *out) const {
+    for (int e = 0; e < kEvents + 2; ++e) out[e] = 0;
+#if defined(__linux__)
+    // value, time_enabled, time_running; the times are the group's, taken from the leader
+    uint64_t buf[3];
+    for (int e = 0; e < kEvents; ++e) {
+        if (fds_[e] < 0 || ::read(fds_[e], buf, sizeof(buf)) != (ssize_t)sizeof(buf)) continue;
+        out[e] = buf[0];
+        if (fds_[e] == leader_) {
+            out[kEvents] = buf[1];
+            out[kEvents + 1] = buf[2];
+        }
+    }
+#endif
+}
+
+void PerfCounters::begin() { read_all(start_); }
+
+void PerfCounters::end(YearPhase phase) {
+    uint64_t now[kEvents + 2];
+    read_all(now);
+    PhaseCounters &t = totals_[(int)phase];
+    const uint64_t enabled = now[kEvents] - start_[kEvents], running = now[kEvents + 1] - start_[kEvents + 1];
+    // scale up to the whole enabled time; a phase the group never ran in counts 0
+    const double scale = running == 0 ? 0.0 : (double)enabled / (double)running;
+    uint64_t *fields[kEvents] = {&t.cycles, &t.instructions, &t.llc_misses, &t.branch_misses, &t.dtlb_misses};
+    for (int e = 0; e < kEvents; ++e) *fields[e] += (uint64_t)((double)(now[e] - start_[e]) * scale + 0.5);
+    t.time_enabled += enabled;
+    t.time_running += running;
+    ++t.samples;
+}
+
+void PerfCounters::reset() {
+    std::memset(totals_, 0, sizeof(totals_));
+    std::memset(start_, 0, sizeof(start_));
+}
+
+} // namespace popsim
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include "phases.hpp"
+
+namespace popsim {
+
+// Hardware counter totals for one phase (user space, calling thread and the
+// worker threads it spawns). When the kernel multiplexes the PMU the counts are
+// scaled up from the time the group was running; time_running / time_enabled is
+// the fraction actually measured (1 = no multiplexing).
+struct PhaseCounters {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t llc_misses;
+    uint64_t branch_misses;
+    uint64_t dtlb_misses;
+    uint64_t samples;      // number of phase executions measured
+    uint64_t time_enabled; // ns the group was enabled during the phase
+    uint64_t time_running; // ns it was counting
+};
+
+// Per-phase hardware counters through Linux perf_event_open, opened as one group
+// so that all events cover the same time windows and ratios (IPC, miss rates)
+// stay meaningful under multiplexing. Counters the CPU or kernel does not offer
+// (VMs, perf_event_paranoid > 2, non-Linux) read as 0; open() fails only if none
+// is available.
+class PerfCounters {
+public:
+    static constexpr int kEvents = 5; // order of the PhaseCounters fields
+
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    bool open();
+    void close();
+    // Counters follow the thread that opened them; reopen them on the calling thread
+    // if it is another one (totals are kept)
+    void follow_calling_thread();
+    bool available(int event) const { return fds_[event] >= 0; }
+
+    void begin();            // snapshot counters at a phase start
+    void end(YearPhase phase); // add the delta since begin() to `phase`
+    const PhaseCounters &totals(YearPhase phase) const { return totals_[(int)phase]; }
+    void reset();
+
+private:
+    // Counter values, then the group's time enabled and time running
+    void read_all(uint64_t *out) const;
+
+    int fds_[kEvents];
+    int leader_; // group leader fd (-1 = none open)
+    long thread_; // thread id the counters were opened on (0 = none)
+    uint64_t start_[kEvents + 2];
+    PhaseCounters totals_[kYearPhaseCount];
+};
+
+} // namespace popsim
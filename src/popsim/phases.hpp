@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace popsim {
+
+// Phases of Population::do_year, in execution order
+enum class YearPhase : uint8_t {
+    Eligibility = 0, // candidate bitsets
+    Marriage = 1,    // monogamy only
+    Conception = 2,  // couples or polygamous mating, including staged births
+    Death = 3,       // mortality, compaction and widowing
+    Bookkeeping = 4, // history, household reorder, state hash
+};
+constexpr std::size_t kYearPhaseCount = 5;
+
+inline const char *year_phase_name(YearPhase p) {
+    static const char *const names[kYearPhaseCount] = {"eligibility", "marriage", "conception", "death",
+                                                       "bookkeeping"};
+    return names[(std::size_t)p];
+}
+
+} // namespace popsim
@@ -3,6 +3,10 @@
 
 from libcpp.vector cimport vector
 from libc.stddef cimport size_t
+from libc.stdint cimport uint64_t
+from libcpp.string cimport string
+from libcpp cimport bool as cppbool
+from libcpp.memory cimport shared_ptr
 
 cdef extern from "population.hpp" namespace "popsim":
     cdef cppclass Environment:
@@ -20,25 +24,212 @@ cdef extern from "population.hpp" namespace "popsim":
         unsigned int male_fertility_max
         Environment()
 
+    cdef enum class CheckpointFormat(unsigned char):
+        Raw
+        Compressed
+
+    cdef enum class MetricsLevel(unsigned char):
+        Off
+        History
+        Hash
+
     cdef cppclass Person:
         unsigned long long id
         unsigned long long g0
         unsigned long long g1
-        unsigned int age
+        int birth_year
         unsigned long long marital
         unsigned int gender
         bint married() const
         unsigned long long partner_id() const
+        unsigned int age(int year) const
+
+    cdef struct DrawRecord:
+        unsigned char phase
+        unsigned char outcome
+        uint64_t person
+        uint64_t value
+
+    cdef struct DrawMismatch:
+        bint found
+        uint64_t index
+        int year
+        DrawRecord expected
+        DrawRecord actual
+
+    cdef enum class YearPhase(unsigned char):
+        pass
+
+    cdef struct PhaseCounters:
+        unsigned long long cycles
+        unsigned long long instructions
+        unsigned long long llc_misses
+        unsigned long long branch_misses
+        unsigned long long dtlb_misses
+        unsigned long long samples
+        unsigned long long time_enabled
+        unsigned long long time_running
+
+    const char* year_phase_name(YearPhase)
+    size_t kYearPhaseCount
+
+    cdef cppclass PersonVector:
+        size_t size() const
+        const Person& operator[](size_t) const
+
+    cdef struct MemoryUsage:
+        size_t people
+        size_t indices
+        size_t histories
+        size_t scratch
+        size_t total
+
+    cdef struct MetricSummary:
+        double min
+        double max
+        double mean
+
+    cdef struct HistorySummary:
+        uint64_t first
+        uint64_t count
+        MetricSummary mean_age
+        MetricSummary population
+        MetricSummary births
+        MetricSummary deaths
+
+    cdef cppclass HistoryRetention:
+        unsigned int recent
+        unsigned int factor
+        unsigned int buckets
+        unsigned int levels
+        HistoryRetention()
+
+    cdef cppclass HistoryLevels:
+        size_t level_count() const
+        const vector[HistorySummary]& level(size_t i) const
+        uint64_t dropped() const
+
+    cdef struct StorageDiagnostics:
+        bint huge_pages
+        size_t bytes
+        size_t huge_page_bytes
+
+    cdef cppclass PopulationSnapshot:
+        uint64_t epoch
+        int year
+        size_t births
+        size_t deaths
+        vector[Person] people
+
+    ctypedef cppbool (*YearObserver)(const Population& pop, void* user)
 
     cdef cppclass Population:
         Population(unsigned long long seed)
         void set_environment(const Environment&)
         const Environment& get_environment() const
-        void initialize_random(size_t N, unsigned int max_start_age)
-        void step(unsigned int years)
-        const vector[Person]& persons() const
+        void initialize_random(size_t N, unsigned int max_start_age) except +
+        unsigned int step(unsigned int years) except + nogil
+        void record_series(const string& path, unsigned int keyframe_interval) except +
+        void stop_series() except +
+        bint recording_series() const
+        void share(const string& name, bint replace) except +
+        void unshare()
+        bint shared() const
+        void enable_snapshots(bint on)
+        bint snapshots_enabled() const
+        shared_ptr[const PopulationSnapshot] latest_snapshot() const
+        uint64_t add_observer(YearObserver fn, void* user)
+        void remove_observer(uint64_t id)
+        void clear_observers()
+        bint observer_stopped() const
+        size_t births_last_year() const
+        size_t deaths_last_year() const
+        MemoryUsage memory_usage() const
+        MemoryUsage peak_memory() const
+        size_t forecast_memory() const
+        void set_memory_limit(size_t bytes, const string& checkpoint_path)
+        bint memory_limit_hit() const
+        void save_checkpoint(const string& path, CheckpointFormat format) except +
+        void load_checkpoint(const string& path) except +
+        void serialize(vector[char]& out, CheckpointFormat format) except +
+        void deserialize(const char* data, size_t size) except +
+        void set_threads(unsigned int n)
+        unsigned int threads() const
+        void set_reorder_interval(unsigned int years)
+        unsigned int reorder_interval() const
+        void reorder_households()
+        void set_huge_pages(bint on)
+        bint huge_pages() const
+        StorageDiagnostics storage_diagnostics() const
+        void enable_tracing(size_t events_per_worker)
+        void disable_tracing()
+        bint tracing() const
+        void write_trace(const string& path) except +
+        bint enable_perf_counters(bint on)
+        bint perf_counters_enabled() const
+        bint perf_counter_available(int event) const
+        PhaseCounters phase_counters(YearPhase phase) const
+        void reset_perf_counters()
+        size_t scratch_heap_allocations() const
+        size_t scratch_capacity() const
+        void set_metrics_level(MetricsLevel level)
+        MetricsLevel metrics_level() const
+        const PersonVector& persons() const
+        int year() const
         const vector[double]& mean_age_history() const
         const vector[size_t]& population_history() const
         const vector[size_t]& births_history() const
         const vector[size_t]& deaths_history() const
+        const vector[uint64_t]& state_hash_history() const
+        uint64_t state_hash_offset() const
+        void set_history_retention(const HistoryRetention& retention)
+        const HistoryRetention& history_retention() const
+        const HistoryLevels& history_levels() const
+        uint64_t history_offset() const
+        unsigned long long state_hash() const
         void reseed(unsigned long long seed)
+        void record_draws(const string& path) except +
+        void replay_draws(const string& path) except +
+        void stop_draws() except +
+        const DrawMismatch& draw_mismatch() const
+
+cdef extern from "async_step.hpp" namespace "popsim":
+    cdef cppclass AsyncStep:
+        AsyncStep(Population& pop, unsigned int years) except +
+        int notify_fd() const
+        void drain()
+        void cancel() nogil
+        unsigned int years_done() const
+        bint finished() const
+        const string& error() const
+        void join() nogil
+
+cdef extern from "series.hpp" namespace "popsim":
+    cdef cppclass SnapshotSeriesReader:
+        SnapshotSeriesReader(const string& path) except +
+        vector[int] years() const
+        vector[Person] read(int year) except +
+
+cdef extern from "shared_export.hpp" namespace "popsim":
+    cdef enum class SharedColumn(unsigned int):
+        Id
+        G0
+        G1
+        BirthYear
+        Marital
+        Gender
+
+    cdef struct SharedSlot:
+        uint64_t sequence
+        uint64_t count
+        int year
+
+    cdef cppclass SharedReader:
+        SharedReader(const string& name) except +
+        const unsigned char* base() const
+        size_t bytes() const
+        uint64_t published() const
+        bint retired() const
+        bint intact(uint64_t seq) const
+        const SharedSlot& slot(uint64_t seq) const
+        size_t column_offset(uint64_t seq, SharedColumn c) const
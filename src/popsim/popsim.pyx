@@ -2,12 +2,39 @@
 # cython: language_level=3
 
 from libcpp.vector cimport vector
+cimport cython
 from libc.stddef cimport size_t
+from cpython.buffer cimport PyBUF_WRITABLE, PyBUF_FORMAT
+from libc.string cimport memcpy
+from libc.stdlib cimport malloc, free
+from libc.stdint cimport int64_t, uint8_t, uint16_t, int32_t, uint32_t
+from cpython.pycapsule cimport PyCapsule_New, PyCapsule_IsValid, PyCapsule_GetPointer
+from cpython.ref cimport Py_INCREF, Py_DECREF
 cimport numpy as cnp
 import numpy as np
 # NOTE: C++ classes Environment/Person/Population are auto-visible from popsimp.pxd
 # Do NOT cimport them again, and do NOT reuse the same names for Python classes.
 
+# DrawPhase values (draw_log.hpp), by index
+_DRAW_PHASES = ("init", "death", "shuffle", "marriage", "conception", "partner", "birth", "mutation")
+
+cdef dict _draw_record(const DrawRecord& r):
+    return {
+        "phase": _DRAW_PHASES[r.phase] if r.phase < len(_DRAW_PHASES) else None,  # None: log exhausted
+        "person": r.person,
+        "value": r.value,
+        "outcome": None if r.outcome == 0xFF else bool(r.outcome),
+    }
+
+cdef dict _memory_usage(const MemoryUsage& m):
+    return {
+        "people": m.people,
+        "indices": m.indices,
+        "histories": m.histories,
+        "scratch": m.scratch,
+        "total": m.total,
+    }
+
 cdef class PyEnvironment:
     cdef Environment _env  # C++ Environment
     def __cinit__(self):
@@ -98,11 +125,57 @@ cdef class PyEnvironment:
     cdef Environment* ptr(self):
         return &self._env
 
+    def __reduce__(self):
+        return (_restore_environment, ((<char*>&self._env)[:sizeof(Environment)],))
+
+def _restore_environment(bytes state):
+    if len(state) != sizeof(Environment):
+        raise ValueError("environment state from an incompatible build")
+    cdef PyEnvironment e = PyEnvironment()
+    memcpy(&e._env, <const char*>state, sizeof(Environment))
+    return e
+
+# Serialized population state handed to pickle; protocol 5 ships it out of band
+cdef class _StateBuffer:
+    cdef vector[char] data
+    cdef Py_ssize_t _shape[1]
+
+    def __getbuffer__(self, Py_buffer* buf, int flags):
+        if flags & PyBUF_WRITABLE:
+            raise BufferError("state buffers are read-only")
+        self._shape[0] = self.data.size()
+        buf.buf = <void*>self.data.data()
+        buf.obj = self
+        buf.len = self.data.size()
+        buf.readonly = 1
+        buf.itemsize = 1
+        buf.format = NULL
+        if flags & PyBUF_FORMAT:
+            buf.format = b"B"
+        buf.ndim = 1
+        buf.shape = self._shape
+        buf.strides = NULL
+        buf.suboffsets = NULL
+        buf.internal = NULL
+
+    def __releasebuffer__(self, Py_buffer* buf):
+        pass
+
+def _restore_population(state, unsigned int threads):
+    cdef PyPopulation p = PyPopulation()
+    p._pop.set_threads(threads)
+    cdef const unsigned char[::1] view = memoryview(state).cast("B")
+    if view.shape[0] == 0:
+        raise ValueError("empty population state")
+    p._pop.deserialize(<const char*>&view[0], view.shape[0])
+    return p
+
 cdef class PersonView:
     cdef unsigned long long _id
     cdef unsigned long long _g0
     cdef unsigned long long _g1
     cdef unsigned int _age
+    cdef int _birth_year
     cdef unsigned long long _marital
     cdef unsigned int _gender
 
@@ -119,6 +192,9 @@ cdef class PersonView:
     def age(self): 
         return self._age
     @property
+    def birth_year(self):
+        return self._birth_year
+    @property
     def married(self): 
         return bool(self._marital & 1)
     @property
@@ -134,6 +210,7 @@ cdef class PersonView:
             "g0": int(self._g0),
             "g1": int(self._g1),
             "age": int(self._age),
+            "birth_year": int(self._birth_year),
             "married": bool(self._marital & 1),
             "partner_id": int(self._marital >> 1),
             "gender": int(self._gender),
@@ -142,66 +219,992 @@ cdef class PersonView:
     def __repr__(self):
         return f"PersonView(id={self._id}, age={self._age}, married={bool(self._marital & 1)}, gender={self._gender})"
 
-cdef inline PersonView _wrap_person(const Person& p):  # C++ Person
+cdef inline PersonView _wrap_person(const Person& p, int year):  # C++ Person
     cdef PersonView v = PersonView.__new__(PersonView)
     v._id = p.id
     v._g0 = p.g0
     v._g1 = p.g1
-    v._age = p.age
+    v._age = p.age(year)
+    v._birth_year = p.birth_year
     v._marital = p.marital
     v._gender = p.gender
     return v
 
 
+# Structured dtype matching the C++ Person layout
+cdef Person _person_layout
+_PERSON_DTYPE = np.dtype({
+    "names": ["id", "g0", "g1", "birth_year", "marital", "gender"],
+    "formats": [np.uint64, np.uint64, np.uint64, np.int32, np.uint64, np.uint32],
+    "offsets": [<size_t>&_person_layout.id - <size_t>&_person_layout,
+                <size_t>&_person_layout.g0 - <size_t>&_person_layout,
+                <size_t>&_person_layout.g1 - <size_t>&_person_layout,
+                <size_t>&_person_layout.birth_year - <size_t>&_person_layout,
+                <size_t>&_person_layout.marital - <size_t>&_person_layout,
+                <size_t>&_person_layout.gender - <size_t>&_person_layout],
+    "itemsize": sizeof(Person),
+})
+
+cdef class PySnapshot:
+    """Immutable end-of-year population published by step(); safe to read from any
+    thread while the simulation continues. `people` views the snapshot without copying
+    and keeps it alive."""
+    cdef shared_ptr[const PopulationSnapshot] _snap
+
+    @property
+    def epoch(self):
+        return self._snap.get().epoch
+    @property
+    def year(self):
+        return self._snap.get().year
+    @property
+    def births(self):
+        return self._snap.get().births
+    @property
+    def deaths(self):
+        return self._snap.get().deaths
+    def __len__(self):
+        return self._snap.get().people.size()
+
+    @property
+    def people(self):
+        """Structured array (id, g0, g1, birth_year, marital, gender), read-only."""
+        return np.frombuffer(self, dtype=_PERSON_DTYPE)
+
+    def ages(self):
+        return self._snap.get().year - self.people["birth_year"]
+
+    def __getbuffer__(self, Py_buffer* buf, int flags):
+        cdef const PopulationSnapshot* s = self._snap.get()
+        if flags & PyBUF_WRITABLE:
+            raise BufferError("snapshots are read-only")
+        buf.buf = <void*>s.people.data()
+        buf.obj = self
+        buf.len = s.people.size() * sizeof(Person)
+        buf.readonly = 1
+        buf.itemsize = 1
+        buf.format = NULL
+        if flags & PyBUF_FORMAT:
+            buf.format = b"B"
+        buf.ndim = 1
+        buf.shape = NULL
+        buf.strides = NULL
+        buf.suboffsets = NULL
+        buf.internal = NULL
+
+    def __releasebuffer__(self, Py_buffer* buf):
+        pass
+
+cdef class PySnapshotSeries:
+    """Reader for a snapshot series written by PyPopulation.record_series."""
+    cdef SnapshotSeriesReader* _reader
+    def __cinit__(self, path):
+        self._reader = new SnapshotSeriesReader(str(path).encode())
+    def __dealloc__(self):
+        del self._reader
+
+    @property
+    def years(self):
+        cdef vector[int] y = self._reader.years()
+        return np.array(y, dtype=np.int32)
+
+    def read(self, int year):
+        """Population at `year` as a structured array (Person layout), ascending by id."""
+        cdef vector[Person] people = self._reader.read(year)
+        out = np.empty(people.size(), dtype=_PERSON_DTYPE)
+        cdef unsigned char[::1] dst = out.view(np.uint8)
+        if people.size():
+            memcpy(&dst[0], people.data(), people.size() * sizeof(Person))
+        return out
+
+# 1-D array of `count` elements of `dtype` copied from `data`
+cdef object _array_copy(const void* data, size_t count, dtype):
+    out = np.empty(count, dtype=dtype)
+    cdef unsigned char[::1] dst = out.view(np.uint8)
+    if count:
+        memcpy(&dst[0], data, count * out.itemsize)
+    return out
+
+# Read-only mapping of a shared segment; column arrays keep it alive
+cdef class _SharedMapping:
+    cdef SharedReader* _reader
+    cdef Py_ssize_t _shape[1]
+    def __dealloc__(self):
+        del self._reader
+
+    def __getbuffer__(self, Py_buffer* buf, int flags):
+        if flags & PyBUF_WRITABLE:
+            raise BufferError("shared segments are read-only")
+        self._shape[0] = self._reader.bytes()
+        buf.buf = <void*>self._reader.base()
+        buf.obj = self
+        buf.len = self._reader.bytes()
+        buf.readonly = 1
+        buf.itemsize = 1
+        buf.format = NULL
+        if flags & PyBUF_FORMAT:
+            buf.format = b"B"
+        buf.ndim = 1
+        buf.shape = self._shape
+        buf.strides = NULL
+        buf.suboffsets = NULL
+        buf.internal = NULL
+
+    def __releasebuffer__(self, Py_buffer* buf):
+        pass
+
+_SHARED_COLUMNS = (
+    ("id", SharedColumn.Id, np.uint64),
+    ("g0", SharedColumn.G0, np.uint64),
+    ("g1", SharedColumn.G1, np.uint64),
+    ("birth_year", SharedColumn.BirthYear, np.int32),
+    ("marital", SharedColumn.Marital, np.uint64),
+    ("gender", SharedColumn.Gender, np.uint32),
+)
+
+cdef class PySharedPopulation:
+    """Reader for a population published with PyPopulation.share(name), typically in
+    another process. Columns are NumPy views of the shared memory, without copies."""
+    cdef _SharedMapping _map
+    cdef object _name
+
+    def __cinit__(self, name):
+        self._name = str(name)
+        self._map = self._open()
+
+    cdef _SharedMapping _open(self):
+        cdef _SharedMapping m = _SharedMapping.__new__(_SharedMapping)
+        m._reader = new SharedReader(self._name.encode())
+        return m
+
+    @property
+    def sequence(self):
+        """Number of the latest publication (0 = none yet)."""
+        return self._map._reader.published()
+
+    def intact(self, uint64_t sequence):
+        """True while publication `sequence` has not been overwritten; views returned for
+        it stay correct until this turns False (two publications later)."""
+        return bool(self._map._reader.intact(sequence))
+
+    def latest(self, copy=False):
+        """{"sequence", "year", "count", and one array per column} for the latest
+        publication, or None before the first. With copy=False the arrays are read-only
+        views (check intact(sequence) after using them); copy=True returns a consistent
+        private copy. A segment replaced by a larger one is reopened transparently."""
+        cdef SharedReader* r
+        cdef uint64_t seq
+        cdef const SharedSlot* slot
+        while True:
+            r = self._map._reader
+            if r.retired():
+                try:
+                    self._map = self._open()
+                except (OSError, RuntimeError):
+                    pass  # the writer is between segments; keep the old mapping meanwhile
+                r = self._map._reader
+            seq = r.published()
+            if seq == 0:
+                return None
+            slot = &r.slot(seq)
+            if slot.sequence != seq:
+                continue  # the slot does not hold this publication (yet); look again
+            out = {"sequence": seq, "year": slot.year, "count": slot.count}
+            n = slot.count
+            for name, col, dtype in _SHARED_COLUMNS:
+                a = np.frombuffer(self._map, dtype=dtype, count=n, offset=r.column_offset(seq, col))
+                out[name] = a.copy() if copy else a
+            if r.intact(seq):
+                return out
+
+# --- DLPack (https://dmlc.github.io/dlpack) structures, legacy and versioned ABI ---
+cdef struct DLDevice:
+    int32_t device_type
+    int32_t device_id
+
+cdef struct DLDataType:
+    uint8_t code
+    uint8_t bits
+    uint16_t lanes
+
+cdef struct DLTensor:
+    void* data
+    DLDevice device
+    int32_t ndim
+    DLDataType dtype
+    int64_t* shape
+    int64_t* strides
+    uint64_t byte_offset
+
+cdef struct DLManagedTensor:
+    DLTensor dl_tensor
+    void* manager_ctx
+    void (*deleter)(DLManagedTensor*) noexcept
+
+cdef struct DLPackVersion:
+    uint32_t major
+    uint32_t minor
+
+cdef struct DLManagedTensorVersioned:
+    DLPackVersion version
+    void* manager_ctx
+    void (*deleter)(DLManagedTensorVersioned*) noexcept
+    uint64_t flags
+    DLTensor dl_tensor
+
+# Tensor plus its shape/strides storage, freed together
+cdef struct _DLHolder:
+    DLManagedTensor managed
+    int64_t shape[1]
+    int64_t strides[1]
+
+cdef struct _DLHolderVersioned:
+    DLManagedTensorVersioned managed
+    int64_t shape[1]
+    int64_t strides[1]
+
+cdef int32_t kDLCPU = 1
+cdef uint64_t kDLReadOnly = 1
+
+cdef void _dl_deleter(DLManagedTensor* t) noexcept with gil:
+    Py_DECREF(<object>t.manager_ctx)
+    free(t)
+
+cdef void _dl_deleter_versioned(DLManagedTensorVersioned* t) noexcept with gil:
+    Py_DECREF(<object>t.manager_ctx)
+    free(t)
+
+# A capsule never consumed still owns its tensor
+cdef void _dl_capsule_destructor(object capsule) noexcept:
+    cdef DLManagedTensor* t
+    if PyCapsule_IsValid(capsule, b"dltensor"):
+        t = <DLManagedTensor*>PyCapsule_GetPointer(capsule, b"dltensor")
+        t.deleter(t)
+
+cdef void _dl_capsule_destructor_versioned(object capsule) noexcept:
+    cdef DLManagedTensorVersioned* t
+    if PyCapsule_IsValid(capsule, b"dltensor_versioned"):
+        t = <DLManagedTensorVersioned*>PyCapsule_GetPointer(capsule, b"dltensor_versioned")
+        t.deleter(t)
+
+# column name -> (Person field offset, element bytes, buffer format, DLPack type code)
+_COLUMNS = {
+    "id": (<size_t>&_person_layout.id - <size_t>&_person_layout, 8, b"Q", 1),
+    "g0": (<size_t>&_person_layout.g0 - <size_t>&_person_layout, 8, b"Q", 1),
+    "g1": (<size_t>&_person_layout.g1 - <size_t>&_person_layout, 8, b"Q", 1),
+    "birth_year": (<size_t>&_person_layout.birth_year - <size_t>&_person_layout, 4, b"i", 0),
+    "marital": (<size_t>&_person_layout.marital - <size_t>&_person_layout, 8, b"Q", 1),
+    "gender": (<size_t>&_person_layout.gender - <size_t>&_person_layout, 4, b"I", 1),
+}
+
+# no_gc_clear: a column freed inside a reference cycle must still see _owner in
+# __dealloc__, or the export count would never drop back to zero
+@cython.no_gc_clear
+cdef class PyColumn:
+    """Zero-copy, read-only strided view of one field of the live population, through
+    the buffer protocol and __dlpack__. While any column (or array made from one) is
+    alive, calls that move or resize the population raise BufferError."""
+    cdef PyPopulation _owner
+    cdef readonly str name
+    cdef char* _data
+    cdef Py_ssize_t _shape[1]
+    cdef Py_ssize_t _strides[1]
+    cdef Py_ssize_t _itemsize
+    cdef bytes _format
+    cdef uint8_t _code
+
+    def __dealloc__(self):
+        if self._owner is not None:
+            self._owner._exports -= 1
+
+    def __len__(self):
+        return self._shape[0]
+
+    def __getbuffer__(self, Py_buffer* buf, int flags):
+        if flags & PyBUF_WRITABLE:
+            raise BufferError("population columns are read-only")
+        buf.buf = self._data
+        buf.obj = self
+        buf.len = self._shape[0] * self._itemsize
+        buf.readonly = 1
+        buf.itemsize = self._itemsize
+        buf.format = NULL
+        if flags & PyBUF_FORMAT:
+            buf.format = self._format
+        buf.ndim = 1
+        buf.shape = self._shape
+        buf.strides = self._strides
+        buf.suboffsets = NULL
+        buf.internal = NULL
+
+    def __releasebuffer__(self, Py_buffer* buf):
+        pass
+
+    def __dlpack_device__(self):
+        return (kDLCPU, 0)
+
+    def __dlpack__(self, *, stream=None, max_version=None, dl_device=None, copy=None):
+        """Versioned (read-only flagged) capsule when the consumer accepts DLPack 1.x,
+        the legacy capsule otherwise. Consumers must not write through it."""
+        if dl_device is not None and tuple(dl_device) != (kDLCPU, 0):
+            raise BufferError("population columns live on the CPU")
+        if copy:
+            raise BufferError("population columns are exported without copying")
+        cdef _DLHolder* h
+        cdef _DLHolderVersioned* hv
+        cdef DLTensor* t
+        if max_version is not None and max_version[0] >= 1:
+            hv = <_DLHolderVersioned*>malloc(sizeof(_DLHolderVersioned))
+            if hv == NULL:
+                raise MemoryError()
+            hv.managed.version.major = 1
+            hv.managed.version.minor = 0
+            hv.managed.manager_ctx = <void*>self
+            hv.managed.deleter = _dl_deleter_versioned
+            hv.managed.flags = kDLReadOnly
+            t = &hv.managed.dl_tensor
+            self._fill_tensor(t, hv.shape, hv.strides)
+            Py_INCREF(self)
+            return PyCapsule_New(&hv.managed, b"dltensor_versioned", _dl_capsule_destructor_versioned)
+        h = <_DLHolder*>malloc(sizeof(_DLHolder))
+        if h == NULL:
+            raise MemoryError()
+        h.managed.manager_ctx = <void*>self
+        h.managed.deleter = _dl_deleter
+        t = &h.managed.dl_tensor
+        self._fill_tensor(t, h.shape, h.strides)
+        Py_INCREF(self)
+        return PyCapsule_New(&h.managed, b"dltensor", _dl_capsule_destructor)
+
+    cdef void _fill_tensor(self, DLTensor* t, int64_t* shape, int64_t* strides):
+        shape[0] = self._shape[0]
+        strides[0] = self._strides[0] // self._itemsize  # DLPack strides count elements
+        t.data = self._data
+        t.device.device_type = kDLCPU
+        t.device.device_id = 0
+        t.ndim = 1
+        t.dtype.code = self._code
+        t.dtype.bits = <uint8_t>(8 * self._itemsize)
+        t.dtype.lanes = 1
+        t.shape = shape
+        t.strides = strides
+        t.byte_offset = 0
+
+# Python year observer; registered with the C++ Population through _call_py_observer
+cdef class _PyObserver:
+    cdef object callback
+    cdef void* owner      # borrowed PyPopulation, which owns this entry
+    cdef object error     # exception raised by callback, re-raised by step()
+
+# Native worker running one step_async call
+cdef class _AsyncStepHandle:
+    cdef AsyncStep* _step
+    cdef object _pop      # PyPopulation, kept alive while the worker runs
+    def __dealloc__(self):
+        if self._step != NULL:
+            with nogil:
+                self._step.cancel()
+                self._step.join()
+            del self._step
+
 cdef class PyPopulation:
     cdef Population* _pop  # C++ Population
+    cdef dict _py_observers  # observer id -> _PyObserver
+    cdef bint _busy          # step() or a step_async worker owns the population
+    cdef int _observing      # Python observers running inside step()
+    cdef Py_ssize_t _exports # live PyColumn objects
     def __cinit__(self, seed: int = 0xC0FFEE):
         self._pop = new Population(<unsigned long long>seed)
+        self._py_observers = {}
     def __dealloc__(self):
         del self._pop
 
     def set_environment(self, PyEnvironment env):
+        self._check_mutable()
         self._pop.set_environment(env._env)
 
     def get_environment(self) -> PyEnvironment:
+        self._check_idle()
         cdef PyEnvironment e = PyEnvironment()
         e._env = self._pop.get_environment()
         return e
 
     def initialize_random(self, int N, int max_start_age=60):
+        self._check_mutable()
+        self._check_not_exported()
         self._pop.initialize_random(N, max_start_age)
 
+    cdef _check_idle(self):
+        # the engine is not thread-safe: while it steps only latest_snapshot() may run
+        if self._busy:
+            raise RuntimeError("population is stepping")
+
+    cdef _check_mutable(self):
+        # observers may read the population they are handed, but not change it
+        self._check_idle()
+        if self._observing:
+            raise RuntimeError("population is read-only inside an observer")
+
+    cdef _check_not_exported(self):
+        if self._exports:
+            raise BufferError("population columns are exported; release them first")
+
+    # --- zero-copy column export (buffer protocol / DLPack) ---
+    def column(self, name):
+        """PyColumn viewing field `name` (id, g0, g1, birth_year, marital, gender) of every
+        person in slot order; np.asarray(col) or any DLPack consumer wraps it without
+        copying. Ages are year() - birth_year."""
+        self._check_mutable()
+        if name not in _COLUMNS:
+            raise KeyError(name)
+        offset, itemsize, fmt, code = _COLUMNS[name]
+        cdef const PersonVector* v = &self._pop.persons()
+        cdef PyColumn c = PyColumn.__new__(PyColumn)
+        c.name = name
+        c._data = <char*>&v[0][0] + <size_t>offset if v.size() else NULL
+        c._shape[0] = v.size()
+        c._strides[0] = sizeof(Person)
+        c._itemsize = itemsize
+        c._format = fmt
+        c._code = code
+        c._owner = self
+        self._exports += 1
+        return c
+
+    def columns(self):
+        """{name: PyColumn} for every exported field."""
+        return {name: self.column(name) for name in _COLUMNS}
+
+    def ages(self):
+        """Ages of every person in slot order (a copy; ages are not stored)."""
+        self._check_idle()
+        cdef const PersonVector* v = &self._pop.persons()
+        cdef int year = self._pop.year()
+        out = np.empty(v.size(), dtype=np.int32)
+        cdef int32_t[::1] a = out
+        cdef Py_ssize_t i
+        for i in range(<Py_ssize_t>v.size()):
+            a[i] = year - v[0][i].birth_year
+        return out
+
     def step(self, int years=1):
+        """Returns the number of years simulated (fewer when the memory limit stopped the run)."""
+        if years < 0:
+            raise ValueError("years must be non-negative")
+        self._check_mutable()
+        self._check_not_exported()
+        cdef unsigned int done
+        self._busy = True
+        try:
+            with nogil:
+                done = self._pop.step(years)
+        finally:
+            self._busy = False
+        self._raise_observer_error()
+        return done
+
+    cdef _raise_observer_error(self):
+        cdef _PyObserver o
+        if self._pop.observer_stopped():
+            for o in self._py_observers.values():
+                if o.error is not None:
+                    e, o.error = o.error, None
+                    raise e
+
+    async def step_async(self, int years=1, progress=None):
+        """Awaitable step() on a native worker thread; returns the years simulated.
+        progress(years_done) is called on the event loop after each year; an exception it
+        raises stops the run and is raised by the await. Cancelling the awaiting task
+        stops the worker after the current year. Until it returns, only
+        latest_snapshot() may be used on this population. Needs a loop that supports
+        add_reader (the default selector loop on POSIX)."""
+        import asyncio
         if years < 0:
             raise ValueError("years must be non-negative")
-        self._pop.step(years)
+        self._check_mutable()
+        self._check_not_exported()
+        loop = asyncio.get_running_loop()
+        cdef _AsyncStepHandle h = _AsyncStepHandle()
+        h._pop = self
+        finished = loop.create_future()
+        reported = 0
+
+        def on_notify():
+            nonlocal reported
+            h._step.drain()
+            done = h._step.years_done()
+            try:
+                while reported < done:
+                    reported += 1
+                    if progress is not None:
+                        progress(reported)
+            except Exception as e:
+                # stop the run and let the awaiting caller see the error
+                h._step.cancel()
+                if not finished.done():
+                    finished.set_exception(e)
+            finally:
+                if h._step.finished() and not finished.done():
+                    finished.set_result(None)
+
+        self._busy = True
+        try:
+            h._step = new AsyncStep(self._pop[0], years)
+            fd = h._step.notify_fd()
+            try:
+                loop.add_reader(fd, on_notify)
+            except BaseException:
+                h._step.cancel()  # e.g. a loop without add_reader
+                raise
+            try:
+                await asyncio.shield(finished)
+            except asyncio.CancelledError:
+                h._step.cancel()
+                await finished
+                raise
+            finally:
+                loop.remove_reader(fd)
+        finally:
+            if h._step != NULL:
+                with nogil:
+                    h._step.join()
+            self._busy = False
+        if not h._step.error().empty():
+            raise RuntimeError(h._step.error().decode())
+        self._raise_observer_error()
+        return h._step.years_done()
+
+    # --- pickling: the whole simulation state, natively serialized ---
+    def __reduce_ex__(self, protocol):
+        """Protocol 5 passes the state as an out-of-band PickleBuffer (no copy by pickle
+        itself; multiprocessing and joblib can then move it as one block). Observers,
+        tracing, counters, snapshots and the draw log are not pickled."""
+        self._check_idle()
+        cdef _StateBuffer buf = _StateBuffer()
+        self._pop.serialize(buf.data, CheckpointFormat.Raw)
+        if protocol >= 5:
+            import pickle
+            state = pickle.PickleBuffer(buf)
+        else:
+            state = bytes(memoryview(buf))
+        return (_restore_population, (state, self._pop.threads()))
+
+    def __reduce__(self):
+        return self.__reduce_ex__(2)
+
+    @property
+    def busy(self):
+        """True while step() or a step_async worker owns the population; its methods
+        then raise RuntimeError, except latest_snapshot()."""
+        return bool(self._busy)
+
+    # --- year observers ---
+    def add_observer(self, callback):
+        """Call callback(population) after every year of step(); returning False stops
+        step() after that year, and an exception stops it and propagates. The callback
+        may read the population but not modify it (RuntimeError). Returns an id for
+        remove_observer."""
+        self._check_mutable()
+        cdef _PyObserver o = _PyObserver()
+        o.callback = callback
+        o.owner = <void*>self
+        cdef uint64_t id = self._pop.add_observer(_call_py_observer, <void*>o)
+        self._py_observers[id] = o
+        return id
+
+    def add_native_observer(self, size_t fn, size_t user=0):
+        """Register a C function `bool fn(const Population&, void* user)` by address (for
+        example <size_t>&my_cdef_fn from Cython); it runs without Python round-trips."""
+        self._check_mutable()
+        if fn == 0:
+            raise ValueError("null observer")
+        return self._pop.add_observer(<YearObserver>fn, <void*>user)
+
+    def remove_observer(self, uint64_t id):
+        self._check_mutable()
+        self._pop.remove_observer(id)
+        self._py_observers.pop(id, None)
+
+    def clear_observers(self):
+        self._check_mutable()
+        self._pop.clear_observers()
+        self._py_observers.clear()
+
+    @property
+    def observer_stopped(self):
+        self._check_idle()
+        return bool(self._pop.observer_stopped())
+
+    # --- snapshot series: keyframes + per-year deltas ---
+    def record_series(self, path, int keyframe_interval=50):
+        """Write the population now and after every year of step() to `path`; read it
+        back with PySnapshotSeries."""
+        self._check_mutable()
+        if keyframe_interval < 0:
+            raise ValueError("keyframe_interval must be non-negative")
+        self._pop.record_series(str(path).encode(), <unsigned int>keyframe_interval)
+
+    def stop_series(self):
+        self._check_mutable()
+        self._pop.stop_series()
+
+    # --- POSIX shared-memory export (read with PySharedPopulation) ---
+    def share(self, name, replace=False):
+        """Publish the population as columns in shared memory segment `name`, now and
+        after every year; removed by unshare() or when this population is destroyed.
+        Raises RuntimeError if the name is in use; replace=True removes that segment
+        first (for one left behind by a crashed writer)."""
+        self._check_mutable()
+        self._pop.share(str(name).encode(), bool(replace))
+
+    def unshare(self):
+        self._check_mutable()
+        self._pop.unshare()
+
+    # --- end-of-year snapshots for concurrent readers ---
+    @property
+    def snapshots(self):
+        self._check_idle()
+        return bool(self._pop.snapshots_enabled())
+    @snapshots.setter
+    def snapshots(self, on):
+        self._check_mutable()
+        self._pop.enable_snapshots(bool(on))
+
+    def latest_snapshot(self):
+        """Latest published PySnapshot, or None. Callable from other threads while step()
+        runs (step releases the GIL); other methods raise RuntimeError until it returns."""
+        cdef shared_ptr[const PopulationSnapshot] s = self._pop.latest_snapshot()
+        if not s:
+            return None
+        cdef PySnapshot v = PySnapshot.__new__(PySnapshot)
+        v._snap = s
+        return v
+
+    def births_last_year(self):
+        self._check_idle()
+        return self._pop.births_last_year()
+
+    def deaths_last_year(self):
+        self._check_idle()
+        return self._pop.deaths_last_year()
+
+    # --- memory accounting (bytes of allocated capacity per structure) ---
+    def memory_usage(self):
+        self._check_idle()
+        return _memory_usage(self._pop.memory_usage())
+
+    def peak_memory(self):
+        self._check_idle()
+        return _memory_usage(self._pop.peak_memory())
+
+    def forecast_memory(self):
+        """Estimated high-water total bytes during the next year."""
+        self._check_idle()
+        return self._pop.forecast_memory()
+
+    def set_memory_limit(self, size_t limit_bytes, checkpoint_path=None):
+        """step() stops before a year forecast to exceed limit_bytes (0 = no limit),
+        writing a checkpoint to checkpoint_path first when given."""
+        self._check_mutable()
+        path = b"" if checkpoint_path is None else str(checkpoint_path).encode()
+        self._pop.set_memory_limit(limit_bytes, path)
+
+    @property
+    def memory_limit_hit(self):
+        self._check_idle()
+        return bool(self._pop.memory_limit_hit())
+
+    # --- checkpoints (binary, same build and platform) ---
+    def save_checkpoint(self, path, compressed=False):
+        """compressed=True column-encodes people and couples (ids, ages, gender, marital)
+        over `threads` workers; load_checkpoint reads either format."""
+        self._check_idle()
+        self._pop.save_checkpoint(str(path).encode(),
+                                  CheckpointFormat.Compressed if compressed else CheckpointFormat.Raw)
+
+    def load_checkpoint(self, path):
+        self._check_mutable()
+        self._check_not_exported()
+        self._pop.load_checkpoint(str(path).encode())
+
+    # worker threads for parallel phases; results do not depend on it
+    @property
+    def threads(self):
+        self._check_idle()
+        return self._pop.threads()
+    @threads.setter
+    def threads(self, int n):
+        self._check_mutable()
+        if n < 0:
+            raise ValueError("threads must be non-negative")
+        self._pop.set_threads(<unsigned int>n)
+
+    # years between household reorders (0 = never); see Population::set_reorder_interval
+    @property
+    def reorder_interval(self):
+        self._check_idle()
+        return self._pop.reorder_interval()
+    @reorder_interval.setter
+    def reorder_interval(self, int years):
+        self._check_mutable()
+        if years < 0:
+            raise ValueError("reorder_interval must be non-negative")
+        self._pop.set_reorder_interval(<unsigned int>years)
+
+    def reorder_households(self):
+        self._check_mutable()
+        self._check_not_exported()
+        self._pop.reorder_households()
+
+    # population arrays on 2 MB transparent huge pages (Linux), with fallback to normal pages
+    @property
+    def huge_pages(self):
+        self._check_idle()
+        return bool(self._pop.huge_pages())
+    @huge_pages.setter
+    def huge_pages(self, on):
+        self._check_mutable()
+        self._check_not_exported()
+        self._pop.set_huge_pages(bool(on))
+
+    def storage_diagnostics(self):
+        self._check_idle()
+        cdef StorageDiagnostics d = self._pop.storage_diagnostics()
+        return {
+            "huge_pages": bool(d.huge_pages),
+            "bytes": d.bytes,
+            "huge_page_bytes": d.huge_page_bytes,
+            "huge_page_coverage": (d.huge_page_bytes / d.bytes) if d.bytes else 0.0,
+        }
+
+    # --- timeline tracing (Chrome trace JSON) ---
+    def enable_tracing(self, size_t events_per_worker=65536):
+        self._check_mutable()
+        self._pop.enable_tracing(events_per_worker)
+
+    def disable_tracing(self):
+        self._check_mutable()
+        self._pop.disable_tracing()
+
+    def write_trace(self, path):
+        self._check_idle()
+        self._pop.write_trace(str(path).encode())
+
+    # --- hardware counters per phase (Linux perf_event_open) ---
+    def enable_perf_counters(self, on=True):
+        """Returns False when no counter can be opened on this machine."""
+        self._check_mutable()
+        return bool(self._pop.enable_perf_counters(bool(on)))
+
+    def reset_perf_counters(self):
+        self._check_mutable()
+        self._pop.reset_perf_counters()
+
+    def perf_counters(self):
+        """{phase: {cycles, instructions, llc_misses, branch_misses, dtlb_misses, samples,
+        running}}; counters this machine does not offer are None. The counters form one
+        group; when the kernel multiplexes them, counts are scaled from the time they ran,
+        and `running` is that fraction of the phase (1.0 = measured throughout). Empty
+        when disabled."""
+        self._check_idle()
+        if not self._pop.perf_counters_enabled():
+            return {}
+        names = ("cycles", "instructions", "llc_misses", "branch_misses", "dtlb_misses")
+        avail = [bool(self._pop.perf_counter_available(e)) for e in range(len(names))]
+        cdef PhaseCounters c
+        out = {}
+        for i in range(kYearPhaseCount):
+            c = self._pop.phase_counters(<YearPhase>i)
+            vals = (c.cycles, c.instructions, c.llc_misses, c.branch_misses, c.dtlb_misses)
+            d = {n: (v if a else None) for n, v, a in zip(names, vals, avail)}
+            d["samples"] = c.samples
+            d["running"] = (c.time_running / c.time_enabled) if c.time_enabled else None
+            out[year_phase_name(<YearPhase>i).decode()] = d
+        return out
+
+    # instrumentation: heap blocks taken by the per-year scratch arena (flat in steady state)
+    def scratch_heap_allocations(self):
+        self._check_idle()
+        return self._pop.scratch_heap_allocations()
+
+    def scratch_capacity(self):
+        self._check_idle()
+        return self._pop.scratch_capacity()
+
+    # metrics level: 0 = off (no history), 1 = history (default), 2 = history + state hash
+    @property
+    def metrics_level(self):
+        self._check_idle()
+        return <int>self._pop.metrics_level()
+    @metrics_level.setter
+    def metrics_level(self, int level):
+        self._check_mutable()
+        if level < 0 or level > 2:
+            raise ValueError("metrics_level must be 0 (off), 1 (history) or 2 (hash)")
+        self._pop.set_metrics_level(<MetricsLevel>level)
 
     def reseed(self, seed: int):
+        self._check_mutable()
         self._pop.reseed(<unsigned long long>seed)
 
+    # --- draw log: record every random decision / replay it against this engine ---
+    def record_draws(self, path):
+        self._check_mutable()
+        self._pop.record_draws(str(path).encode())
+
+    def replay_draws(self, path):
+        self._check_mutable()
+        self._pop.replay_draws(str(path).encode())
+
+    def stop_draws(self):
+        self._check_mutable()
+        self._pop.stop_draws()
+
+    def draw_mismatch(self):
+        """First divergence found while replaying, or None."""
+        self._check_idle()
+        cdef const DrawMismatch* m = &self._pop.draw_mismatch()
+        if not m.found:
+            return None
+        return {
+            "index": m.index,
+            "year": m.year,
+            "expected": _draw_record(m.expected),
+            "actual": _draw_record(m.actual),
+        }
+
+    def year(self):
+        self._check_idle()
+        return self._pop.year()
+
     def persons(self):
-        cdef vector[Person] v = self._pop.persons()
+        self._check_idle()
+        cdef const PersonVector* v = &self._pop.persons()
+        cdef int year = self._pop.year()
         out = []
         out_extend = out.append
         cdef Py_ssize_t i, n = v.size()
         for i in range(n):
-            out_extend(_wrap_person(v[i]))
+            out_extend(_wrap_person(v[0][i], year))
         return out
         
+    # *_history() return NumPy copies of the engine's vectors, one memcpy each
     def mean_age_history(self):
-        cdef vector[double] h = self._pop.mean_age_history()
-        cdef Py_ssize_t i, n = h.size()
-        return [h[i] for i in range(n)]
+        self._check_idle()
+        cdef const vector[double]* h = &self._pop.mean_age_history()
+        return _array_copy(h.data(), h.size(), np.float64)
 
     def population_history(self):
-        cdef vector[size_t] h = self._pop.population_history()
-        cdef Py_ssize_t i, n = h.size()
-        return [h[i] for i in range(n)]
+        self._check_idle()
+        cdef const vector[size_t]* h = &self._pop.population_history()
+        return _array_copy(h.data(), h.size(), np.uintp)
 
     def births_history(self):
-        cdef vector[size_t] h = self._pop.births_history()
-        return [h[i] for i in range(h.size())]
+        self._check_idle()
+        cdef const vector[size_t]* h = &self._pop.births_history()
+        return _array_copy(h.data(), h.size(), np.uintp)
 
     def deaths_history(self):
-        cdef vector[size_t] h = self._pop.deaths_history()
-        return [h[i] for i in range(h.size())]
\ No newline at end of file
+        self._check_idle()
+        cdef const vector[size_t]* h = &self._pop.deaths_history()
+        return _array_copy(h.data(), h.size(), np.uintp)
+
+    # --- bounded history: full-resolution recent window + min/max/mean summary levels ---
+    def set_history_retention(self, int recent, int factor=4, int buckets=64, int levels=8):
+        """Keep at least the last `recent` years at full resolution (0 = keep everything);
+        older years are summarized in buckets of factor, factor**2, ... years, up to
+        `buckets` per level over `levels` levels."""
+        self._check_mutable()
+        if recent < 0 or factor < 2 or buckets < factor or levels < 1:
+            raise ValueError("need recent >= 0, factor >= 2, buckets >= factor, levels >= 1")
+        cdef HistoryRetention r
+        r.recent = recent
+        r.factor = factor
+        r.buckets = buckets
+        r.levels = levels
+        self._pop.set_history_retention(r)
+
+    def history_retention(self):
+        self._check_idle()
+        cdef const HistoryRetention* r = &self._pop.history_retention()
+        return {"recent": r.recent, "factor": r.factor, "buckets": r.buckets, "levels": r.levels}
+
+    @property
+    def history_offset(self):
+        """History entry index of the first element of the *_history() arrays."""
+        self._check_idle()
+        return self._pop.history_offset()
+
+    def history_summary(self):
+        """Summary buckets older than the recent window, oldest first, as a structured
+        array with first/count (history entry range), level, and min/max/mean per metric."""
+        self._check_idle()
+        cdef const HistoryLevels* hl = &self._pop.history_levels()
+        fields = [("first", np.uint64), ("count", np.uint64), ("level", np.uint8)]
+        for m in ("mean_age", "population", "births", "deaths"):
+            fields += [(m + "_min", np.float64), (m + "_max", np.float64), (m + "_mean", np.float64)]
+        cdef Py_ssize_t total = 0, k = 0, i
+        cdef int lv
+        for lv in range(<int>hl.level_count()):
+            total += hl.level(lv).size()
+        out = np.empty(total, dtype=fields)
+        cdef const HistorySummary* b
+        for lv in reversed(range(<int>hl.level_count())):
+            for i in range(<Py_ssize_t>hl.level(lv).size()):
+                b = &hl.level(lv)[i]
+                out[k] = (b.first, b.count, lv,
+                          b.mean_age.min, b.mean_age.max, b.mean_age.mean,
+                          b.population.min, b.population.max, b.population.mean,
+                          b.births.min, b.births.max, b.births.mean,
+                          b.deaths.min, b.deaths.max, b.deaths.mean)
+                k += 1
+        return out
+
+    def state_hash(self):
+        self._check_idle()
+        return self._pop.state_hash()
+
+    def state_hash_history(self):
+        self._check_idle()
+        cdef const vector[uint64_t]* h = &self._pop.state_hash_history()
+        return _array_copy(h.data(), h.size(), np.uint64)
+
+    @property
+    def state_hash_offset(self):
+        """Hash number of the first element of state_hash_history()."""
+        self._check_idle()
+        return self._pop.state_hash_offset()
+
+
+# Runs a Python observer inside step(), which hands the population back to its
+# observers, read-only, for the duration of the call
+cdef cppbool _call_py_observer(const Population& pop, void* user) noexcept with gil:
+    cdef _PyObserver o = <_PyObserver>user
+    cdef PyPopulation owner = <PyPopulation>o.owner
+    owner._busy = False
+    owner._observing += 1
+    try:
+        return o.callback(owner) is not False
+    except BaseException as e:
+        o.error = e
+        return False
+    finally:
+        owner._observing -= 1
+        owner._busy = True
+
+
+def first_divergent_year(PyPopulation a, PyPopulation b):
+    """Index of the first year whose state hashes differ (both runs need metrics_level=2),
+    or None if the years both histories still hold match. With a history retention set,
+    only years inside both recent windows can be compared."""
+    ha = a.state_hash_history()
+    hb = b.state_hash_history()
+    oa = a.state_hash_offset
+    ob = b.state_hash_offset
+    start = max(oa, ob)
+    end = min(oa + len(ha), ob + len(hb))
+    if end <= start:
+        return None
+    diff = np.flatnonzero(ha[start - oa:end - oa] != hb[start - ob:end - ob])
+    return start + int(diff[0]) if diff.size else None
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include "population.hpp"
+#include "series.hpp"
+#include "shared_export.hpp"
 #include <cmath>
-#include <unordered_set>
+#include <numeric>
+#include <stdexcept>
 
 #if defined(__GNUC__) || defined(__clang__)
 static inline int popcount64(uint64_t x) { return __builtin_popcountll(x); }
@@ -13,16 +16,173 @@ static inline int popcount64(uint64_t x) {
 }
 #endif
 
+#if defined(__GNUC__) || defined(__clang__)
+static inline int ctz64(uint64_t x) { return __builtin_ctzll(x); }
+#else
+static inline int ctz64(uint64_t x) { return popcount64((x & (0ull - x)) - 1ull); }
+#endif
+
+// Call f(slot) for every set bit, in ascending slot order
+template <class Bits, class F>
+static inline void for_each_set_bit(const Bits &bits, F &&f) {
+    for (size_t w = 0; w < bits.size(); ++w) {
+        for (uint64_t x = bits[w]; x != 0ull; x &= x - 1ull) f((uint32_t)(w * 64 + (size_t)ctz64(x)));
+    }
+}
+
+template <class Bits>
+static inline size_t count_set_bits(const Bits &bits) {
+    size_t n = 0;
+    for (uint64_t x : bits) n += (size_t)popcount64(x);
+    return n;
+}
+
+// murmur3 64-bit finaliser
+static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ull;
+    return x ^ (x >> 33);
+}
+
+// all-ones when c, else 0: lets the mask pass combine conditions without branches
+static inline uint64_t mask_if(bool c) { return 0ull - (uint64_t)c; }
+
 namespace popsim {
 
-Population::Population(uint64_t seed) : rng_(seed), next_id_(1ull) {}
+Population::Population(uint64_t seed)
+    : rng_(seed), next_id_(1ull), year_(0), people_hash_(0), id_ordered_(true), metrics_(MetricsLevel::History), reorder_interval_(0),
+      threads_(1), births_this_year(0), deaths_this_year(0), history_offset_(0), state_hash_offset_(0), mismatch_{}, instrumented_(false),
+      phase_start_ns_(0), next_observer_id_(1), observer_stopped_(false), peak_memory_{}, memory_limit_(0),
+      memory_limit_hit_(false), births_prev_year_(0), weddings_this_year_(0), weddings_prev_year_(0), trend_years_(0),
+      scratch_per_person_(0.0) {
+    compile_environment();
+}
+
+Population::~Population() = default;
 
 void Population::reseed(uint64_t seed) { rng_.seed(seed); }
 
-void Population::set_environment(const Environment &env) { env_ = env; }
+void Population::record_draws(const std::string &path) {
+    draws_.open_record(path);
+    mismatch_ = DrawMismatch{};
+}
+
+void Population::replay_draws(const std::string &path) {
+    draws_.open_replay(path);
+    mismatch_ = DrawMismatch{};
+}
+
+void Population::stop_draws() { draws_.close(); }
+
+uint64_t Population::logged_draw(DrawPhase phase, uint64_t person) {
+    DrawRecord actual{(uint8_t)phase, DrawRecord::kNoOutcome, person, 0ull};
+    if (draws_.mode() == DrawMode::Record) {
+        actual.value = rng_();
+        draws_.write(actual);
+        return actual.value;
+    }
+    DrawRecord expected;
+    if (!replay_next(actual, expected)) return rng_();
+    return expected.value;
+}
+
+bool Population::logged_decision(DrawPhase phase, uint64_t person, uint64_t threshold) {
+    DrawRecord actual{(uint8_t)phase, 0u, person, 0ull};
+    if (draws_.mode() == DrawMode::Record) {
+        actual.value = rng_();
+        actual.outcome = actual.value < threshold ? 1u : 0u;
+        draws_.write(actual);
+        return actual.outcome != 0u;
+    }
+    DrawRecord expected;
+    if (!replay_next(actual, expected)) return rng_() < threshold;
+    actual.value = expected.value;
+    actual.outcome = actual.value < threshold ? 1u : 0u;
+    if (actual.outcome != expected.outcome) note_mismatch(expected, actual);
+    return actual.outcome != 0u;
+}
+
+// Read the next logged draw for `actual`; false (and the engine falls back to rng_)
+// once the log is exhausted or has diverged
+bool Population::replay_next(const DrawRecord &actual, DrawRecord &expected) {
+    if (mismatch_.found) return false;
+    if (!draws_.read(expected)) {
+        expected = DrawRecord{0xFFu, DrawRecord::kNoOutcome, 0ull, 0ull};
+        note_mismatch(expected, actual);
+        return false;
+    }
+    if (expected.phase != actual.phase || expected.person != actual.person) {
+        note_mismatch(expected, actual);
+        return false;
+    }
+    return true;
+}
+
+void Population::note_mismatch(const DrawRecord &expected, const DrawRecord &actual) {
+    if (mismatch_.found) return;
+    mismatch_.found = true;
+    mismatch_.index = expected.phase == 0xFFu ? draws_.count() : draws_.count() - 1;
+    mismatch_.year = year_;
+    mismatch_.expected = expected;
+    mismatch_.actual = actual;
+}
+
+void Population::set_environment(const Environment &env) {
+    env_ = env;
+    compile_environment();
+}
+
+void Population::set_huge_pages(bool on) {
+    PopulationAllocator<Person> alloc(on);
+    PersonVector people(alloc), spare(alloc), newborns(alloc);
+    people.reserve(people_.capacity());
+    people.assign(people_.begin(), people_.end());
+    spare.reserve(spare_.capacity());
+    newborns.reserve(newborns_.capacity());
+    // allocators propagate on swap, so the flag moves with the storage
+    people_.swap(people);
+    spare_.swap(spare);
+    newborns_.swap(newborns);
+}
+
+StorageDiagnostics Population::storage_diagnostics() const {
+    StorageDiagnostics d{};
+    d.huge_pages = huge_pages();
+    d.bytes = (people_.capacity() + spare_.capacity()) * sizeof(Person);
+    d.huge_page_bytes = huge_page_bytes(people_.data(), people_.capacity() * sizeof(Person)) +
+                        huge_page_bytes(spare_.data(), spare_.capacity() * sizeof(Person));
+    return d;
+}
+
+uint64_t Population::probability_threshold(double p) {
+    // U(0,1) from mt19937_64 is one raw draw scaled by 2^-64, so compare in integer space.
+    // p >= 1 maps to the largest threshold; only the single draw 2^64-1 is then rejected.
+    if (!(p > 0.0)) return 0ull;
+    if (p >= 1.0) return std::numeric_limits<uint64_t>::max();
+    return (uint64_t)std::ldexp(p, 64);
+}
+
+uint8_t Population::eligibility_slow(uint32_t gender, uint32_t age) const {
+    if (age < env_.age_of_consent) return 0u;
+    bool fertile = gender == 0u ? fertile_female(age) : fertile_male(age);
+    return fertile ? (uint8_t)(kCanMarry | kCanConceive) : kCanMarry;
+}
+
+void Population::compile_environment() {
+    for (uint32_t a = 0; a < kAgeBins; ++a) {
+        death_threshold_[a] = probability_threshold(std::clamp((double)env_.dying_curve[a], 0.0, 1.0));
+        eligibility_[0][a] = eligibility_slow(0u, a);
+        eligibility_[1][a] = eligibility_slow(1u, a);
+    }
+}
 
 void Population::initialize_random(std::size_t N, uint32_t max_start_age) {
     people_.clear();
+    couples_.clear();
+    id_ordered_ = true;
+    by_id_.clear();
     people_.reserve(N);
     std::uniform_int_distribution<uint32_t> age_dist(0u, max_start_age);
     std::uniform_int_distribution<uint32_t> gender_dist(0u, 1u);
@@ -30,15 +190,28 @@ void Population::initialize_random(std::size_t N, uint32_t max_start_age) {
     for (std::size_t i = 0; i < N; ++i) {
         Person p{};
         p.id = next_id_++;
-        p.g0 = gene_dist(rng_);
-        p.g1 = gene_dist(rng_);
-        p.age = age_dist(rng_);
-        p.gender = gender_dist(rng_);
+        TaggedDraws draws = draws_for(DrawPhase::Init, p.id);
+        p.g0 = gene_dist(draws);
+        p.g1 = gene_dist(draws);
+        p.birth_year = year_ - (int32_t)age_dist(draws);
+        p.gender = gender_dist(draws);
         p.marital = 0ull; // unmarried
         people_.push_back(p);
     }
+    draws_.flush();
+    rehash_people();
     mean_age_hist_.clear();
     pop_hist_.clear();
+    births_hist_.clear();
+    deaths_hist_.clear();
+    state_hash_hist_.clear();
+    history_levels_.clear();
+    history_offset_ = 0;
+    state_hash_offset_ = 0;
+    births_this_year = 0;
+    deaths_this_year = 0;
+    trend_years_ = 0;
+    scratch_per_person_ = 0.0;
 }
 
 // Count equal bits across both 64-bit genome words (total 128 bits)
@@ -49,80 +222,580 @@ bool Population::incest_blocked(const Person &a, const Person &b) const {
     return (uint32_t)eq > env_.incest_threshold;
 }
 
+template <bool Polygamy, bool Mutate, MetricsLevel Metrics>
 void Population::do_year() {
+    births_prev_year_ = births_this_year;
+    weddings_prev_year_ = weddings_this_year_;
+    births_this_year = 0;
+    deaths_this_year = 0;
+    weddings_this_year_ = 0;
+    scratch_.reset();
+    // one label for every phase of the year, although the Death phase advances year_
+    if (tracer_) tracer_->set_year(year_);
+
     // marriages or polygamy mating choice happens before aging/deaths to keep order consistent
-    if (!env_.polygamy) {
-        marriages();
-        conceiving();
-    } else {
-        polygamous_conceiving();
+    {
+        EligibilityMasks masks(scratch_);
+        phase_begin();
+        build_eligibility_masks(masks);
+        phase_end(YearPhase::Eligibility);
+        if constexpr (!Polygamy) {
+            phase_begin();
+            marriages(masks);
+            phase_end(YearPhase::Marriage);
+        }
+        phase_begin();
+        begin_births();
+        if constexpr (!Polygamy) {
+            conceiving<Mutate>();
+        } else {
+            polygamous_conceiving<Mutate>(masks);
+        }
+        flush_births();
+        phase_end(YearPhase::Conception);
     }
 
-    // Age and deaths
-    births_this_year = 0;
-    deaths_this_year = 0;
-    std::vector<Person> survivors;
-    survivors.reserve(people_.size());
-    age_and_maybe_die(survivors);
-    people_.swap(survivors);
+    // Age and deaths (survivors go to the spare buffer, which keeps its capacity across years)
+    phase_begin();
+    const std::size_t year_people = people_.size();
+    spare_.clear();
+    spare_.reserve(year_people);
+    double sum_age = age_and_maybe_die<Metrics>(spare_);
+    people_.swap(spare_);
+    scratch_per_person_ = year_people == 0 ? 0.0 : (double)scratch_.requested() / (double)year_people;
+    if (trend_years_ < 2) ++trend_years_;
+    phase_end(YearPhase::Death);
 
     // Metrics
-    births_hist_.push_back(births_this_year);
-    deaths_hist_.push_back(deaths_this_year);
+    phase_begin();
+    if constexpr (Metrics != MetricsLevel::Off) {
+        births_hist_.push_back(births_this_year);
+        deaths_hist_.push_back(deaths_this_year);
+        double mean_age = people_.empty() ? 0.0 : sum_age / (double)people_.size();
+        mean_age_hist_.push_back(mean_age);
+        pop_hist_.push_back(people_.size());
+    }
+
+    if (reorder_interval_ != 0 && year_ % (int32_t)reorder_interval_ == 0) reorder_households();
+    if constexpr (Metrics == MetricsLevel::Hash) state_hash_hist_.push_back(state_hash());
+    if constexpr (Metrics != MetricsLevel::Off) {
+        // trimming waits for twice the window so the front erase is amortized
+        const std::size_t window = history_levels_.retention().recent;
+        if (window != 0 && (pop_hist_.size() >= 2 * window || state_hash_hist_.size() >= 2 * window)) {
+            trim_history();
+        }
+    }
+    phase_end(YearPhase::Bookkeeping);
+}
+
+void Population::instrument_begin() {
+    if (perf_) perf_->begin();
+    if (tracer_) phase_start_ns_ = tracer_->now_ns();
+}
+
+void Population::instrument_end(YearPhase phase) {
+    if (perf_) perf_->end(phase);
+    if (tracer_) tracer_->record(0, year_phase_name(phase), phase_start_ns_, tracer_->year());
+}
+
+bool Population::enable_perf_counters(bool on) {
+    if (!on) {
+        perf_.reset();
+    } else if (!perf_) {
+        auto counters = std::make_unique<PerfCounters>();
+        if (!counters->open()) return false;
+        perf_ = std::move(counters);
+    }
+    instrumented_ = perf_ || tracer_;
+    return true;
+}
+
+void Population::enable_tracing(std::size_t events_per_worker) {
+    tracer_ = std::make_unique<Tracer>(events_per_worker);
+    instrumented_ = true;
+}
+
+void Population::disable_tracing() {
+    tracer_.reset();
+    instrumented_ = perf_ != nullptr;
+}
+
+void Population::write_trace(const std::string &path) const {
+    if (!tracer_) throw std::runtime_error("tracing is not enabled");
+    tracer_->write_chrome_trace(path);
+}
+
+PhaseCounters Population::phase_counters(YearPhase phase) const {
+    return perf_ ? perf_->totals(phase) : PhaseCounters{};
+}
+
+void Population::reset_perf_counters() {
+    if (perf_) perf_->reset();
+}
+
+uint64_t Population::person_hash(const Person &p) {
+    // fields chained through the finaliser, so the terms of different people are unrelated
+    uint64_t h = mix64(p.id ^ 0x9E3779B97F4A7C15ull);
+    h = mix64(h ^ p.g0);
+    h = mix64(h ^ p.g1);
+    h = mix64(h ^ ((uint64_t)(uint32_t)p.birth_year | ((uint64_t)p.gender << 32)));
+    return mix64(h ^ p.marital);
+}
+
+void Population::rehash_people() {
+    people_hash_ = 0;
+    for (const auto &p : people_) people_hash_ += person_hash(p);
+}
+
+uint64_t Population::state_hash() const {
+    uint64_t h = mix64((uint64_t)people_.size() ^ ((uint64_t)(uint32_t)year_ << 32));
+    h = mix64(h ^ people_hash_);
+    h = mix64(h ^ next_id_);
+    // couples in table order: the pair order and wedding years drive later draws, and
+    // neither is visible in people_ (which only records who is married to whom)
+    h = mix64(h ^ (uint64_t)couples_.size());
+    for (const Couple &c : couples_) {
+        h = mix64(h ^ people_[c.mother].id);
+        h = mix64(h ^ people_[c.father].id);
+        h = mix64(h ^ (uint64_t)(uint32_t)c.married_year);
+    }
+    // RNG position: the next outputs of a copy identify the engine state
+    std::mt19937_64 probe = rng_;
+    for (int i = 0; i < 4; ++i) h = mix64(h ^ probe());
+    return h;
+}
+
+void Population::reorder_households() {
+    scratch_.reset();
+    ScratchVector<uint32_t> slot_map(people_.size(), kNoSlot, ArenaAllocator<uint32_t>(scratch_));
+    spare_.clear();
+    spare_.reserve(people_.size());
+    for (const auto &c : couples_) {
+        slot_map[c.mother] = (uint32_t)spare_.size();
+        spare_.push_back(people_[c.mother]);
+        slot_map[c.father] = (uint32_t)spare_.size();
+        spare_.push_back(people_[c.father]);
+    }
+    ScratchVector<uint32_t> rest{ArenaAllocator<uint32_t>(scratch_)};
+    rest.reserve(people_.size() - spare_.size());
+    for (uint32_t i = 0; i < (uint32_t)people_.size(); ++i) {
+        if (slot_map[i] == kNoSlot) rest.push_back(i);
+    }
+    std::sort(rest.begin(), rest.end(),
+              [this](uint32_t a, uint32_t b) { return people_[a].id < people_[b].id; });
+    for (uint32_t i : rest) {
+        slot_map[i] = (uint32_t)spare_.size();
+        spare_.push_back(people_[i]);
+    }
+    remap_couples(spare_, slot_map); // nobody is dropped, so this only moves slots
+    if (id_ordered_) {
+        by_id_.resize(people_.size());
+        for (uint32_t i = 0; i < (uint32_t)people_.size(); ++i) by_id_[i] = slot_map[i];
+    } else {
+        for (uint32_t &i : by_id_) i = slot_map[i];
+    }
+    people_.swap(spare_);
+    id_ordered_ = std::is_sorted(people_.begin(), people_.end(),
+                                 [](const Person &a, const Person &b) { return a.id < b.id; });
+    if (id_ordered_) by_id_.clear();
+}
+
+void Population::rebuild_id_order() {
+    id_ordered_ = std::is_sorted(people_.begin(), people_.end(),
+                                 [](const Person &a, const Person &b) { return a.id < b.id; });
+    by_id_.clear();
+    if (id_ordered_) return;
+    by_id_.resize(people_.size());
+    std::iota(by_id_.begin(), by_id_.end(), 0u);
+    std::sort(by_id_.begin(), by_id_.end(), [this](uint32_t a, uint32_t b) { return people_[a].id < people_[b].id; });
+}
+
+Population::YearKernel Population::select_year_kernel() const {
+    // [polygamy][mutation][metrics level]
+    static constexpr YearKernel kernels[2][2][3] = {
+        {{&Population::do_year<false, false, MetricsLevel::Off>,
+          &Population::do_year<false, false, MetricsLevel::History>,
+          &Population::do_year<false, false, MetricsLevel::Hash>},
+         {&Population::do_year<false, true, MetricsLevel::Off>,
+          &Population::do_year<false, true, MetricsLevel::History>,
+          &Population::do_year<false, true, MetricsLevel::Hash>}},
+        {{&Population::do_year<true, false, MetricsLevel::Off>,
+          &Population::do_year<true, false, MetricsLevel::History>,
+          &Population::do_year<true, false, MetricsLevel::Hash>},
+         {&Population::do_year<true, true, MetricsLevel::Off>,
+          &Population::do_year<true, true, MetricsLevel::History>,
+          &Population::do_year<true, true, MetricsLevel::Hash>}},
+    };
+    return kernels[env_.polygamy ? 1 : 0][env_.mutation_bits != 0u ? 1 : 0][(size_t)metrics_];
+}
+
+void Population::set_history_retention(const HistoryRetention &retention) {
+    history_levels_.configure(retention);
+    if (retention.recent != 0) trim_history();
+}
+
+// Fold the oldest entries beyond the recent window into level-0 buckets, in whole
+// buckets so bucket boundaries stay fixed relative to entry 0
+void Population::trim_history() {
+    const std::size_t window = history_levels_.retention().recent;
+    const std::size_t factor = history_levels_.retention().factor;
+    if (pop_hist_.size() > window) {
+        const std::size_t n = (pop_hist_.size() - window) / factor * factor;
+        for (std::size_t i = 0; i < n; i += factor) {
+            history_levels_.add(summarize_history(history_offset_ + i, &mean_age_hist_[i], &pop_hist_[i],
+                                                  &births_hist_[i], &deaths_hist_[i], factor));
+        }
+        mean_age_hist_.erase(mean_age_hist_.begin(), mean_age_hist_.begin() + n);
+        pop_hist_.erase(pop_hist_.begin(), pop_hist_.begin() + n);
+        births_hist_.erase(births_hist_.begin(), births_hist_.begin() + n);
+        deaths_hist_.erase(deaths_hist_.begin(), deaths_hist_.begin() + n);
+        history_offset_ += n;
+    }
+    if (state_hash_hist_.size() > window) {
+        const std::size_t n = state_hash_hist_.size() - window;
+        state_hash_hist_.erase(state_hash_hist_.begin(), state_hash_hist_.begin() + n);
+        state_hash_offset_ += n;
+    }
+}
+
+uint32_t Population::step(uint32_t years) {
+    YearKernel kernel = select_year_kernel();
+    if (perf_) perf_->follow_calling_thread(); // step_async runs on its own worker
+    memory_limit_hit_ = false;
+    observer_stopped_ = false;
+    for (uint32_t i = 0; i < years; ++i) {
+        if (memory_limit_ != 0 && forecast_memory() > memory_limit_) {
+            memory_limit_hit_ = true;
+            if (!memory_checkpoint_.empty()) save_checkpoint(memory_checkpoint_);
+            return i;
+        }
+        if (series_) series_->begin_year(next_id_);
+        (this->*kernel)();
+        draws_.flush();
+        update_peak_memory();
+        if (snapshots_) publish_snapshot();
+        if (series_) {
+            try {
+                series_->end_year(*this);
+            } catch (...) {
+                series_.reset(); // records after a failed one would be unreadable
+                throw;
+            }
+        }
+        if (shared_) shared_->publish(year_, people_.data(), people_.size(), threads_);
+        if (!observers_.empty() && !notify_observers()) {
+            observer_stopped_ = true;
+            return i + 1;
+        }
+    }
+    return years;
+}
+
+void Population::record_series(const std::string &path, uint32_t keyframe_interval) {
+    stop_series();
+    auto series = std::make_unique<SnapshotSeriesWriter>(path, keyframe_interval);
+    series->write_keyframe(*this);
+    series_ = std::move(series);
+}
+
+void Population::stop_series() {
+    std::unique_ptr<SnapshotSeriesWriter> series = std::move(series_);
+    if (series) series->close();
+}
+
+void Population::share(const std::string &name, bool replace) {
+    shared_.reset();
+    shared_ = std::make_unique<SharedExporter>(name, replace);
+    shared_->publish(year_, people_.data(), people_.size(), threads_);
+}
+
+void Population::unshare() { shared_.reset(); }
+
+void Population::enable_snapshots(bool on) {
+    if (!on) {
+        snapshots_.reset();
+        return;
+    }
+    if (!snapshots_) snapshots_ = std::make_unique<SnapshotPublisher>();
+    publish_snapshot();
+}
+
+std::shared_ptr<const PopulationSnapshot> Population::latest_snapshot() const {
+    return snapshots_ ? snapshots_->latest() : nullptr;
+}
+
+void Population::publish_snapshot() {
+    snapshots_->publish(year_, births_this_year, deaths_this_year, people_.data(), people_.size());
+}
+
+uint64_t Population::add_observer(YearObserver fn, void *user) {
+    observers_.push_back(ObserverSlot{next_observer_id_, fn, user});
+    return next_observer_id_++;
+}
+
+void Population::remove_observer(uint64_t id) {
+    observers_.erase(std::remove_if(observers_.begin(), observers_.end(),
+                                    [id](const ObserverSlot &o) { return o.id == id; }),
+                     observers_.end());
+}
+
+// Indexed loop: an observer may remove observers (through its owner) while it runs
+bool Population::notify_observers() {
+    bool keep_going = true;
+    for (std::size_t k = 0; k < observers_.size(); ++k) {
+        const ObserverSlot o = observers_[k];
+        if (!o.fn(*this, o.user)) keep_going = false;
+    }
+    return keep_going;
+}
+
+// Capacity after a range insert or resize to `need` elements: libc++ grows to
+// max(2 * capacity, need), libstdc++ to at most that
+static std::size_t grown_capacity(std::size_t capacity, std::size_t need) {
+    return need <= capacity ? capacity : std::max(need, 2 * capacity);
+}
+
+// Capacity after push_back up to `need` elements (doubling); `peak` is set to the most
+// elements held at once, old and new array both being live while it reallocates
+static std::size_t pushed_capacity(std::size_t capacity, std::size_t need, std::size_t &peak) {
+    std::size_t c = capacity;
+    peak = capacity;
+    while (c < need) {
+        const std::size_t next = c == 0 ? 1 : 2 * c;
+        peak = c + next;
+        c = next;
+    }
+    return c;
+}
+
+// Last value plus its latest increase; a falling trend is not extrapolated
+static std::size_t extrapolate(std::size_t last, std::size_t before) {
+    return last >= before ? last + (last - before) : last;
+}
+
+MemoryUsage Population::memory_usage() const {
+    MemoryUsage m{};
+    m.people = (people_.capacity() + spare_.capacity() + newborns_.capacity()) * sizeof(Person);
+    m.indices = couples_.capacity() * sizeof(Couple) + by_id_.capacity() * sizeof(uint32_t);
+    m.histories = mean_age_hist_.capacity() * sizeof(double) + pop_hist_.capacity() * sizeof(std::size_t) +
+                  births_hist_.capacity() * sizeof(size_t) + deaths_hist_.capacity() * sizeof(size_t) +
+                  state_hash_hist_.capacity() * sizeof(uint64_t) + history_levels_.memory_bytes();
+    m.scratch = scratch_.capacity();
+    m.total = m.people + m.indices + m.histories + m.scratch;
+    return m;
+}
+
+void Population::forecast_year(std::size_t &births, std::size_t &weddings) const {
+    if (trend_years_ != 0) {
+        births = trend_years_ == 2 ? extrapolate(births_this_year, births_prev_year_) : births_this_year;
+        weddings = trend_years_ == 2 ? extrapolate(weddings_this_year_, weddings_prev_year_) : weddings_this_year_;
+        return;
+    }
+    // no trend yet: at most one birth per fertile woman, one wedding per single pair
+    std::size_t mothers = 0, single_women = 0, single_men = 0;
+    for (const Person &p : people_) {
+        const uint8_t e = eligibility(p.gender, p.age(year_));
+        if (p.gender == 0u && (e & kCanConceive)) ++mothers;
+        if (!p.married() && (e & kCanMarry)) ++(p.gender == 0u ? single_women : single_men);
+    }
+    births = mothers;
+    weddings = env_.polygamy ? 0 : std::min(single_women, single_men);
+}
+
+std::size_t Population::forecast_memory() const {
+    // the trends get the same 1/16 margin as the total, so that an error in them cannot
+    // hide a reallocation
+    std::size_t births, weddings;
+    forecast_year(births, weddings);
+    births += births / 16;
+    weddings += weddings / 16;
+    const std::size_t n = people_.size(), need = n + births;
+    const bool reorder = reorder_interval_ != 0 && (year_ + 1) % (int32_t)reorder_interval_ == 0;
+
+    // people: newborns are staged (reserved for twice last year's births, then doubling)
+    // and appended to people_, which may reallocate while the old array is live; the
+    // survivors buffer is then reserved for everyone and the two arrays swap. Every
+    // reallocation briefly holds the old and the new array.
+    const std::size_t expected = 2 * births_this_year; // what begin_births will reserve
+    std::size_t staged = newborns_.capacity(), staging = staged, pushing;
+    if (expected > staged) {
+        staging = staged + expected;
+        staged = expected;
+    }
+    staged = pushed_capacity(staged, births, pushing);
+    staging = std::max(staging, pushing);
+    const std::size_t live = grown_capacity(people_.capacity(), need);
+    const std::size_t spare = std::max(spare_.capacity(), need);
+    const std::size_t appending = people_.capacity() + (live != people_.capacity() ? live : 0) + spare_.capacity();
+    const std::size_t reserving = live + spare_.capacity() + (spare != spare_.capacity() ? spare : 0);
+    std::size_t bytes = std::max(people_.capacity() + spare_.capacity() + staging,
+                                 std::max(appending, reserving) + staged) * sizeof(Person);
+
+    // indices: weddings are pushed onto the couples table; the id order gains the
+    // newborns, or is built by a reorder
+    std::size_t couples, by_id = by_id_.capacity();
+    pushed_capacity(couples_.capacity(), couples_.size() + weddings, couples);
+    if (!id_ordered_) pushed_capacity(by_id, by_id_.size() + births, by_id);
+    else if (reorder && need > by_id) by_id += grown_capacity(by_id, need);
+    bytes += couples * sizeof(Couple) + by_id * sizeof(uint32_t);
+
+    // scratch: last year's demand per person, or else a bound on the phases' buffers
+    // (masks, candidate lists and shuffle temporaries, the death pass slot map)
+    const std::size_t demand = scratch_per_person_ > 0.0 ? (std::size_t)(scratch_per_person_ * (double)need) + 1
+                                                         : n / 2 + 9 * n + 4 * need + (std::size_t(1) << 16);
+    std::size_t scratch = ScratchArena::capacity_after(scratch_.capacity(), demand);
+    if (reorder) scratch = ScratchArena::capacity_after(scratch, 8 * need + 256); // slot map and rest
+    bytes += scratch;
+
+    // histories: one more entry each (summary levels change by a bucket at most)
+    auto next = [](const auto &v, bool recorded) {
+        std::size_t peak = v.capacity();
+        if (recorded) pushed_capacity(v.capacity(), v.size() + 1, peak);
+        return peak * sizeof(v[0]);
+    };
+    const bool history = metrics_ != MetricsLevel::Off;
+    bytes += next(mean_age_hist_, history) + next(pop_hist_, history) + next(births_hist_, history) +
+             next(deaths_hist_, history) + next(state_hash_hist_, metrics_ == MetricsLevel::Hash);
+    bytes += history_levels_.memory_bytes();
+    return bytes + bytes / 16;
+}
+
+void Population::set_memory_limit(std::size_t bytes, const std::string &checkpoint_path) {
+    memory_limit_ = bytes;
+    memory_checkpoint_ = checkpoint_path;
+}
+
+void Population::update_peak_memory() {
+    MemoryUsage m = memory_usage();
+    peak_memory_.people = std::max(peak_memory_.people, m.people);
+    peak_memory_.indices = std::max(peak_memory_.indices, m.indices);
+    peak_memory_.histories = std::max(peak_memory_.histories, m.histories);
+    peak_memory_.scratch = std::max(peak_memory_.scratch, m.scratch);
+    peak_memory_.total = std::max(peak_memory_.total, m.total);
+}
+
+template <MetricsLevel Metrics>
+double Population::age_and_maybe_die(PersonVector &out) {
+    // advance the clock instead of touching every person's age
+    ++year_;
+    ScratchVector<uint32_t> slot_map(people_.size(), ArenaAllocator<uint32_t>(scratch_));
+    // death: the partner is widowed through the couples table below
+    auto dies = [this](const Person &p) {
+        uint32_t age = p.age(year_);
+        uint32_t idx = age < kAgeBins ? age : kAgeBins - 1u;
+        if (!decide(DrawPhase::Death, p.id, death_threshold_[idx])) return false;
+        deaths_this_year++;
+        people_hash_ -= person_hash(p);
+        if (series_) series_->died(p.id);
+        return true;
+    };
     double sum_age = 0.0;
-    for (const auto &p : people_) sum_age += (double)p.age;
-    double mean_age = people_.empty() ? 0.0 : sum_age / (double)people_.size();
-    mean_age_hist_.push_back(mean_age);
-    pop_hist_.push_back(people_.size());
-}
-
-void Population::step(uint32_t years) {
-    for (uint32_t i = 0; i < years; ++i) do_year();
-}
-
-void Population::age_and_maybe_die(std::vector<Person> &out) {
-    std::uniform_real_distribution<double> U(0.0, 1.0);
-    for (auto &p : people_) {
-        // increment age at start of year
-        if (p.age < std::numeric_limits<uint32_t>::max()) p.age += 1u;
-        uint32_t idx = p.age < 128u ? p.age : 127u;
-        double prob = std::clamp((double)env_.dying_curve[idx], 0.0, 1.0);
-        if (U(rng_) < prob) {
-            // death: if married, clear partner's marital if still present
-            deaths_this_year++;
-            if (p.married()) {
-                uint64_t partner = p.partner_id();
-                for (auto &q : people_) {
-                    if (q.id == partner && q.married() && q.partner_id() == p.id) {
-                        q.marital = 0ull;
-                        break;
-                    }
-                }
+    if (id_ordered_) {
+        for (uint32_t i = 0; i < (uint32_t)people_.size(); ++i) {
+            const auto &p = people_[i];
+            if (dies(p)) {
+                slot_map[i] = kNoSlot;
+                continue; // skip adding to survivors
             }
-            continue; // skip adding to survivors
+            slot_map[i] = (uint32_t)out.size();
+            out.push_back(p);
+            if constexpr (Metrics != MetricsLevel::Off) sum_age += (double)p.age(year_);
         }
-        out.push_back(p);
+    } else {
+        // draw in id order, then keep survivors in layout order
+        for (uint32_t i : by_id_) slot_map[i] = dies(people_[i]) ? kNoSlot : 0u;
+        for (uint32_t i = 0; i < (uint32_t)people_.size(); ++i) {
+            if (slot_map[i] == kNoSlot) continue;
+            slot_map[i] = (uint32_t)out.size();
+            out.push_back(people_[i]);
+            if constexpr (Metrics != MetricsLevel::Off) sum_age += (double)people_[i].age(year_);
+        }
+        std::size_t kept = 0;
+        for (uint32_t i : by_id_) {
+            if (slot_map[i] != kNoSlot) by_id_[kept++] = slot_map[i];
+        }
+        by_id_.resize(kept);
     }
+    remap_couples(out, slot_map);
+    return sum_age;
 }
 
-void Population::marriages() {
-    // Eligible unmarried adults by gender
-    std::vector<uint32_t> fem, male;
-    fem.reserve(people_.size());
-    male.reserve(people_.size());
-    for (uint32_t i = 0; i < (uint32_t)people_.size(); ++i) {
-        const auto &p = people_[i];
-        if (p.married()) continue;
-        if (p.age < env_.age_of_consent) continue;
-        if (p.gender == 0u) fem.push_back(i); else male.push_back(i);
+void Population::remap_couples(PersonVector &people, const ScratchVector<uint32_t> &slot_map) {
+    size_t kept = 0;
+    for (const auto &c : couples_) {
+        uint32_t m = slot_map[c.mother];
+        uint32_t f = slot_map[c.father];
+        if (m == kNoSlot || f == kNoSlot) {
+            if (m != kNoSlot) set_marital(people[m], 0ull);
+            if (f != kNoSlot) set_marital(people[f], 0ull);
+            continue;
+        }
+        Couple moved = c;
+        moved.mother = m;
+        moved.father = f;
+        couples_[kept++] = moved;
     }
-    std::shuffle(fem.begin(), fem.end(), rng_);
-    std::shuffle(male.begin(), male.end(), rng_);
+    couples_.resize(kept);
+}
+
+void Population::build_eligibility_masks(EligibilityMasks &masks) const {
+    const size_t n = people_.size();
+    const size_t words = (n + 63) / 64;
+    masks.single_female.resize(words);
+    masks.single_male.resize(words);
+    masks.fertile_female.resize(words);
+    masks.fertile_male.resize(words);
+    for (size_t w = 0; w < words; ++w) {
+        const size_t base = w * 64;
+        const size_t end = std::min(n, base + 64);
+        uint64_t sf = 0ull, sm = 0ull, ff = 0ull, fm = 0ull;
+        for (size_t i = base; i < end; ++i) {
+            const Person &p = people_[i];
+            const uint8_t e = eligibility(p.gender, p.age(year_));
+            const uint64_t bit = 1ull << (i - base);
+            const uint64_t male = mask_if(p.gender != 0u);
+            const uint64_t single = mask_if(!p.married()) & mask_if((e & kCanMarry) != 0u);
+            const uint64_t fertile = mask_if((e & kCanConceive) != 0u);
+            sf |= bit & ~male & single;
+            sm |= bit & male & single;
+            ff |= bit & ~male & fertile;
+            fm |= bit & male & fertile;
+        }
+        masks.single_female[w] = sf;
+        masks.single_male[w] = sm;
+        masks.fertile_female[w] = ff;
+        masks.fertile_male[w] = fm;
+    }
+}
+
+template <class Bits, class F>
+void Population::for_each_in_id_order(const Bits &bits, F &&f) const {
+    if (id_ordered_) {
+        for_each_set_bit(bits, f);
+        return;
+    }
+    for (uint32_t i : by_id_) {
+        if ((bits[i / 64] >> (i % 64)) & 1ull) f(i);
+    }
+}
+
+void Population::marriages(const EligibilityMasks &masks) {
+    // Eligible unmarried adults by gender
+    ScratchVector<uint32_t> fem{ArenaAllocator<uint32_t>(scratch_)};
+    ScratchVector<uint32_t> male{ArenaAllocator<uint32_t>(scratch_)};
+    fem.reserve(count_set_bits(masks.single_female));
+    male.reserve(count_set_bits(masks.single_male));
+    for_each_in_id_order(masks.single_female, [&](uint32_t i) { fem.push_back(i); });
+    for_each_in_id_order(masks.single_male, [&](uint32_t i) { male.push_back(i); });
+    // seeds drawn up front: the shuffles are thread-count independent
+    const uint64_t fem_seed = next_draw(DrawPhase::Shuffle, 0ull);
+    const uint64_t male_seed = next_draw(DrawPhase::Shuffle, 0ull);
+    parallel_shuffle(fem, fem_seed, threads_, scratch_, tracer_.get());
+    parallel_shuffle(male, male_seed, threads_, scratch_, tracer_.get());
 
     double pressure = 1.0 - (people_.empty() ? 0.0 : ((double)people_.size() /env_.resources ));
     pressure = std::clamp(pressure, 0.0, 1.0);
-    double p_marry = std::clamp(env_.marriage_probability * pressure, 0.0, 1.0);
-    std::uniform_real_distribution<double> U(0.0, 1.0);
+    uint64_t marry_threshold = probability_threshold(env_.marriage_probability * pressure);
 
     size_t pairs = std::min(fem.size(), male.size());
     for (size_t k = 0; k < pairs; ++k) {
@@ -130,82 +803,64 @@ void Population::marriages() {
         uint32_t j = male[k];
         if (people_[i].married() || people_[j].married()) continue; // race condition avoidance
         if (incest_blocked(people_[i], people_[j])) continue;
-        if (U(rng_) < p_marry) {
+        if (decide(DrawPhase::Marriage, people_[i].id, marry_threshold)) {
             uint64_t id_i = people_[i].id;
             uint64_t id_j = people_[j].id;
-            people_[i].marital = make_marital_field(id_j);
-            people_[j].marital = make_marital_field(id_i);
+            set_marital(people_[i], make_marital_field(id_j));
+            set_marital(people_[j], make_marital_field(id_i));
+            weddings_this_year_++;
+            couples_.push_back(Couple{i, j, year_, people_[i].birth_year, people_[j].birth_year});
         }
     }
 }
 
+template <bool Mutate>
 void Population::conceiving() {
-    std::uniform_real_distribution<double> U(0.0, 1.0);
     double pressure = 1.0 - (people_.empty() ? 0.0 : ((double)people_.size() / env_.resources));
     pressure = std::clamp(pressure, 0.0, 1.0);
-    double p_child = std::clamp(env_.conceiving_probability * pressure, 0.0, 1.0);
+    uint64_t child_threshold = probability_threshold(env_.conceiving_probability * pressure);
 
-    // Iterate over married females of age >= consent and with male partner >= consent
-    for (uint32_t i = 0; i < (uint32_t)people_.size(); ++i) {
-        auto &mother = people_[i];
-        if (mother.gender != 0u) continue; // female only
-        if (!mother.married()) continue;
-        if (mother.age < env_.age_of_consent) continue;
-        // NEW fertility window for mother
-        if (!fertile_female(mother.age)) continue;
-        // find partner index (linear scan; for big populations, consider a map)
-        uint64_t pid = mother.partner_id();
-        int32_t father_idx = -1;
-        for (uint32_t j = 0; j < (uint32_t)people_.size(); ++j) {
-            if (people_[j].id == pid) { father_idx = (int32_t)j; break; }
+    // Iterate over couples (wedding order) whose partners are both >= consent and fertile;
+    // the table only ever pairs a female with a male, so no gender or partner lookup is needed
+    for (const auto &c : couples_) {
+        uint32_t mother_age = (uint32_t)(year_ - c.mother_birth_year);
+        uint32_t father_age = (uint32_t)(year_ - c.father_birth_year);
+        if (!(eligibility(0u, mother_age) & eligibility(1u, father_age) & kCanConceive)) continue;
+        if (incest_blocked(people_[c.mother], people_[c.father])) continue;
+        if (decide(DrawPhase::Conception, people_[c.mother].id, child_threshold)) {
+            add_child<Mutate>(c.mother, c.father);
         }
-        if (father_idx < 0) continue;
-        auto &father = people_[(uint32_t)father_idx];
-        if (father.gender != 1u) continue;
-        if (father.age < env_.age_of_consent) continue;
-        if (incest_blocked(mother, father)) continue;
-        // NEW fertility window for father
-        if (!fertile_male(father.age)) continue;
-        if (U(rng_) < p_child) add_child(i, (uint32_t)father_idx);
     }
 }
 
-void Population::polygamous_conceiving() {
-    std::uniform_real_distribution<double> U(0.0, 1.0);
+template <bool Mutate>
+void Population::polygamous_conceiving(const EligibilityMasks &masks) {
     double pressure = 1.0 - (people_.empty() ? 0.0 : (env_.resources / (double)people_.size()));
     pressure = std::clamp(pressure, 0.0, 1.0);
-    double p_child = std::clamp(env_.conceiving_probability * pressure, 0.0, 1.0);
+    uint64_t child_threshold = probability_threshold(env_.conceiving_probability * pressure);
 
     // collect eligible males
-    std::vector<uint32_t> males;
-    for (uint32_t i = 0; i < (uint32_t)people_.size(); ++i) {
-        if (people_[i].gender == 1u &&
-            people_[i].age >= env_.age_of_consent &&
-            fertile_male(people_[i].age)) {
-            males.push_back(i);
-        }
-    }
+    ScratchVector<uint32_t> males{ArenaAllocator<uint32_t>(scratch_)};
+    males.reserve(count_set_bits(masks.fertile_male));
+    for_each_in_id_order(masks.fertile_male, [&](uint32_t i) { males.push_back(i); });
     if (males.empty()) return;
     std::uniform_int_distribution<size_t> male_pick(0u, males.size() - 1u);
 
-    for (uint32_t i = 0; i < (uint32_t)people_.size(); ++i) {
-        auto &mother = people_[i];
-        if (mother.gender != 0u) continue;
-        if (mother.age < env_.age_of_consent) continue;
-        // NEW fertility window for mother
-        if (!fertile_female(mother.age)) continue;
-        uint32_t father_idx = males[male_pick(rng_)];
-        auto &father = people_[father_idx];
-        if (incest_blocked(mother, father)) continue;
-        if (U(rng_) < p_child) add_child(i, father_idx);
-    }
+    for_each_in_id_order(masks.fertile_female, [&](uint32_t i) {
+        TaggedDraws partner_draws = draws_for(DrawPhase::Partner, people_[i].id);
+        uint32_t father_idx = males[male_pick(partner_draws)];
+        if (incest_blocked(people_[i], people_[father_idx])) return;
+        if (decide(DrawPhase::Conception, people_[i].id, child_threshold)) add_child<Mutate>(i, father_idx);
+    });
 }
 
+template <bool Mutate>
 void Population::add_child(uint32_t mother_idx, uint32_t father_idx) {
     // Simple uniform per-bit recombination: choose parent bit with 50% chance
     std::uniform_int_distribution<uint64_t> mask_dist(0ull, std::numeric_limits<uint64_t>::max());
-    uint64_t m0 = mask_dist(rng_);
-    uint64_t m1 = mask_dist(rng_);
+    TaggedDraws draws = draws_for(DrawPhase::Birth, next_id_);
+    uint64_t m0 = mask_dist(draws);
+    uint64_t m1 = mask_dist(draws);
 
     const auto &mom = people_[mother_idx];
     const auto &dad = people_[father_idx];
@@ -214,26 +869,53 @@ void Population::add_child(uint32_t mother_idx, uint32_t father_idx) {
     child.id = next_id_++;
     child.g0 = (mom.g0 & m0) | (dad.g0 & ~m0);
     child.g1 = (mom.g1 & m1) | (dad.g1 & ~m1);
-    child.age = 0u;
-    child.gender = (mask_dist(rng_) & 1ull) ? 1u : 0u; // 50/50
+    child.birth_year = year_;
+    child.gender = (mask_dist(draws) & 1ull) ? 1u : 0u; // 50/50
     child.marital = 0ull;
     // NEW: mutate newborn genome by flipping exactly env_.mutation_bits positions
-    mutate_child(child, env_.mutation_bits);
+    if constexpr (Mutate) mutate_child(child, env_.mutation_bits);
     births_this_year++;
+    people_hash_ += person_hash(child);
 
-    people_.push_back(child);
+    // staged so people_ never reallocates under the conception loops
+    newborns_.push_back(child);
+}
+
+void Population::begin_births() {
+    // grow geometrically from last year's births so push_back rarely reallocates; the
+    // counter, unlike births_hist_, is kept at every metrics level (do_year has already
+    // moved it to births_prev_year_)
+    size_t expected = 2 * births_prev_year_;
+    newborns_.clear();
+    if (newborns_.capacity() < expected) newborns_.reserve(expected);
+}
+
+void Population::flush_births() {
+    // newborns carry the highest ids, so they extend the id order as they are
+    if (!id_ordered_) {
+        for (std::size_t k = 0; k < newborns_.size(); ++k) by_id_.push_back((uint32_t)(people_.size() + k));
+    }
+    people_.insert(people_.end(), newborns_.begin(), newborns_.end());
+    newborns_.clear();
 }
 
 void Population::mutate_child(Person &child, uint32_t k) {
     if (k == 0) return;
-    std::unordered_set<int> pos;
-    pos.reserve(k);
+    k = std::min(k, 128u);
+    // distinct positions tracked in a 128-bit mask; redraw on repeats
+    uint64_t flip0 = 0ull, flip1 = 0ull;
     std::uniform_int_distribution<int> pick(0, 127);
-    while ((uint32_t)pos.size() < k) pos.insert(pick(rng_));
-    for (int b : pos) {
-        if (b < 64) child.g0 ^= (1ull << b);
-        else        child.g1 ^= (1ull << (b - 64));
+    TaggedDraws draws = draws_for(DrawPhase::Mutation, child.id);
+    for (uint32_t n = 0; n < k;) {
+        int b = pick(draws);
+        uint64_t &word = b < 64 ? flip0 : flip1;
+        uint64_t bit = 1ull << (b & 63);
+        if (word & bit) continue;
+        word |= bit;
+        ++n;
     }
+    child.g0 ^= flip0;
+    child.g1 ^= flip1;
 }
 
 } // namespace popsim
\ No newline at end of file
@@ -1,10 +1,20 @@
 #pragma once
 #include <cstdint>
+#include <iosfwd>
 #include <vector>
 #include <random>
 #include <algorithm>
 #include <utility>
 #include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "draw_log.hpp"
+#include "history.hpp"
+#include "perf_counters.hpp"
+#include "scratch_arena.hpp"
+#include "shuffle.hpp"
+#include "storage.hpp"
 
 namespace popsim {
 struct Environment {
@@ -41,8 +51,8 @@ struct Person {
     // 2) 2x64-bit genome
     uint64_t g0;
     uint64_t g1;
-    // 3) age counter
-    uint32_t age;
+    // 3) birth year; age is derived from the population's current year
+    int32_t birth_year;
     // 4) marital: LSB = 1 if married, MSB63 = partner id; 0 if unmarried
     uint64_t marital;
     // 5) gender: 0=female, 1=male (current model)
@@ -50,11 +60,92 @@ struct Person {
 
     bool married() const { return (marital & 1ull) != 0ull; }
     uint64_t partner_id() const { return marital >> 1; }
+    uint32_t age(int32_t year) const { return (uint32_t)(year - birth_year); }
 };
 
+// Main population storage (see storage.hpp for the huge-page option)
+using PersonVector = std::vector<Person, PopulationAllocator<Person>>;
+
+// Where the population arrays live
+struct StorageDiagnostics {
+    bool huge_pages;            // huge-page storage requested
+    std::size_t bytes;          // bytes reserved for people (live + spare buffer)
+    std::size_t huge_page_bytes; // of those, bytes the kernel backs with huge pages
+};
+
+// Bytes held by each internal structure (allocated capacity, not just live data)
+struct MemoryUsage {
+    std::size_t people;    // population arrays: live, survivors buffer, newborn staging
+    std::size_t indices;   // couples table and id order
+    std::size_t histories; // per-year metric histories
+    std::size_t scratch;   // per-year scratch arena
+    std::size_t total;
+};
+
+// Checkpoint encodings; load_checkpoint accepts either
+enum class CheckpointFormat : uint8_t {
+    Raw = 0,        // people and couples as in memory
+    Compressed = 1, // column codecs (column_codec.hpp), chunked over the worker threads
+};
+
+// How much per-year bookkeeping do_year performs
+enum class MetricsLevel : uint8_t {
+    Off = 0,     // no history is recorded (fast burn-in)
+    History = 1, // population, births, deaths and mean age per year (default)
+    Hash = 2,    // History plus a hash of the full state at the end of every year
+};
+
+// Married pair, kept densely so conception never scans the whole population.
+// Slots index into Population::persons() and are remapped whenever it is compacted.
+struct Couple {
+    uint32_t mother;            // slot of the wife
+    uint32_t father;            // slot of the husband
+    int32_t married_year;       // Population::year() at the wedding
+    int32_t mother_birth_year;  // cached so the fertility filter stays inside the table
+    int32_t father_birth_year;
+};
+
+// Immutable end-of-year copy of the population, shared with reader threads
+struct PopulationSnapshot {
+    uint64_t epoch;      // publication counter, 1 for the first snapshot
+    int32_t year;        // Population::year() when taken; ages are relative to it
+    std::size_t births;  // of the year that just ended
+    std::size_t deaths;
+    std::vector<Person> people;
+};
+
+// Double-buffered publication of snapshots. The simulation thread copies into a
+// buffer no reader holds (reusing its capacity) and swaps it in as the latest; the
+// lock only guards that pointer swap, so readers never wait for a copy and the writer
+// never waits for readers. Readers keep a snapshot alive as long as they hold it; a
+// new buffer is allocated only when every pooled one is still held.
+class SnapshotPublisher {
+public:
+    // Simulation thread only
+    void publish(int32_t year, std::size_t births, std::size_t deaths, const Person *people, std::size_t n);
+    // Any thread; null before the first publish
+    std::shared_ptr<const PopulationSnapshot> latest() const;
+    std::size_t buffers() const { return pool_.size(); }
+
+private:
+    mutable std::mutex mutex_;
+    std::shared_ptr<PopulationSnapshot> latest_;
+    std::vector<std::shared_ptr<PopulationSnapshot>> pool_;
+    uint64_t epoch_ = 0;
+};
+
+class Population;
+class SnapshotSeriesWriter;
+class SharedExporter;
+
+// Called after every simulated year with read-only access to the population and the
+// pointer given at registration; returning false stops step() after that year
+using YearObserver = bool (*)(const Population &pop, void *user);
+
 class Population {
 public:
     explicit Population(uint64_t seed = 0xC0FFEEULL);
+    ~Population();
 
     // Replace the whole environment
     void set_environment(const Environment &env);
@@ -63,26 +154,195 @@ public:
     // Create N random persons (clears existing)
     void initialize_random(std::size_t N, uint32_t max_start_age = 60);
 
-    // Advance the simulation by `years` ticks
-    void step(uint32_t years = 1);
+    // Advance the simulation by `years` ticks. Returns the number of years simulated,
+    // which is smaller only when the memory limit or an observer stopped the run.
+    uint32_t step(uint32_t years = 1);
+
+    // Year observers run in registration order on the thread calling step(), after the
+    // year's bookkeeping; exceptions they throw propagate out of step(). add_observer
+    // returns the id for remove_observer.
+    uint64_t add_observer(YearObserver fn, void *user = nullptr);
+    void remove_observer(uint64_t id);
+    void clear_observers() { observers_.clear(); }
+    bool observer_stopped() const { return observer_stopped_; }
+    // End-of-year snapshots for concurrent readers: while enabled, a snapshot is published
+    // now and after every year of step(). latest_snapshot() may be called from any thread,
+    // including while step() runs; enabling and disabling may not.
+    void enable_snapshots(bool on);
+    bool snapshots_enabled() const { return snapshots_ != nullptr; }
+    std::shared_ptr<const PopulationSnapshot> latest_snapshot() const;
+
+    // Snapshot series (series.hpp): a keyframe now and after every `keyframe_interval`
+    // years (0 = only now), a compact delta after every other year of step(). Throws
+    // std::runtime_error if the file cannot be opened.
+    void record_series(const std::string &path, uint32_t keyframe_interval = 50);
+    void stop_series();
+    bool recording_series() const { return series_ != nullptr; }
+
+    // Publish the population as columns in the POSIX shared-memory segment `name`
+    // (shared_export.hpp) now and after every year of step(); the segment is removed by
+    // unshare() or on destruction. Throws std::runtime_error if it cannot be created or
+    // the name is in use, unless `replace` (removes a stale segment of a crashed writer).
+    void share(const std::string &name, bool replace = false);
+    void unshare();
+    bool shared() const { return shared_ != nullptr; }
+
+    // Births and deaths of the last simulated year, at any metrics level
+    std::size_t births_last_year() const { return births_this_year; }
+    std::size_t deaths_last_year() const { return deaths_this_year; }
 
-    // Access persons
-    const std::vector<Person>& persons() const { return people_; }
+    // Memory accounting. peak_memory() holds per-structure high-water marks sampled
+    // after every year. forecast_memory() estimates the high-water total during the next
+    // year, reached while people_ grows and the old array is still live: it replays how
+    // every structure grows in a year from the birth and wedding trends of the last two
+    // years (or, before there is a trend, from their bounds in the current population),
+    // with a 1/16 margin on the trends and on the total. Deaths come after the arrays grow,
+    // so they never lower it.
+    MemoryUsage memory_usage() const;
+    MemoryUsage peak_memory() const { return peak_memory_; }
+    std::size_t forecast_memory() const;
+    // Before each year, if the forecast exceeds `bytes` (0 = no limit) step() stops,
+    // saving a checkpoint to `checkpoint_path` first when it is non-empty.
+    void set_memory_limit(std::size_t bytes, const std::string &checkpoint_path = std::string());
+    bool memory_limit_hit() const { return memory_limit_hit_; }
 
-    // Metrics history (one entry per year advanced)
+    // Complete simulation state (environment, people, couples, RNG, histories) in a
+    // binary file for the same build and platform; throw std::runtime_error on I/O or
+    // format errors. Runtime options (threads, tracing, counters, draw log) are not saved.
+    void save_checkpoint(const std::string &path, CheckpointFormat format = CheckpointFormat::Raw) const;
+    void load_checkpoint(const std::string &path);
+    void save_state(std::ostream &out, CheckpointFormat format = CheckpointFormat::Raw) const;
+    void load_state(std::istream &in);
+    // The same state in memory (pickling): `out` is replaced; `data` is read in place
+    void serialize(std::vector<char> &out, CheckpointFormat format = CheckpointFormat::Raw) const;
+    void deserialize(const char *data, std::size_t size);
+
+    // Put the population arrays on 2 MB transparent huge pages (Linux; falls back to
+    // normal pages). Existing people are moved to the new storage.
+    void set_huge_pages(bool on);
+    bool huge_pages() const { return people_.get_allocator().huge_pages; }
+    StorageDiagnostics storage_diagnostics() const;
+
+    // Per-phase hardware counters (Linux perf_event_open). enable_perf_counters(true)
+    // returns false when no counter can be opened here; totals accumulate across
+    // step() calls until reset_perf_counters(). They count the thread calling step()
+    // (and the workers it spawns), whichever thread that is.
+    bool enable_perf_counters(bool on);
+    bool perf_counters_enabled() const { return perf_ != nullptr; }
+    bool perf_counter_available(int event) const { return perf_ && perf_->available(event); }
+    PhaseCounters phase_counters(YearPhase phase) const;
+    void reset_perf_counters();
+
+    // Timeline tracing: phases of every year on the driving thread plus parallel work on
+    // each worker, in per-worker buffers of `events_per_worker` events (later events are
+    // dropped). write_trace() emits Chrome trace JSON and throws std::runtime_error if
+    // the file cannot be written.
+    void enable_tracing(std::size_t events_per_worker = std::size_t(1) << 16);
+    void disable_tracing();
+    bool tracing() const { return tracer_ != nullptr; }
+    void write_trace(const std::string &path) const;
+
+    // Instrumentation: heap blocks requested by the per-year scratch arena so far
+    std::size_t scratch_heap_allocations() const { return scratch_.heap_allocations(); }
+    std::size_t scratch_capacity() const { return scratch_.capacity(); }
+
+    // Threads used by the parallel parts of a year. Results depend only on the seed,
+    // never on this value.
+    void set_threads(unsigned n) { threads_ = n == 0 ? 1u : n; }
+    unsigned threads() const { return threads_; }
+
+    // Every `years` years (0 = never), lay people out in the household order: couples in
+    // wedding order with each wife directly followed by her husband, then everyone else
+    // by ascending id. Spouses become neighbours in memory. Phases draw in the canonical
+    // order (ascending id, the layout without reordering), so the interval changes only
+    // the layout, never the trajectory.
+    void set_reorder_interval(uint32_t years) { reorder_interval_ = years; }
+    uint32_t reorder_interval() const { return reorder_interval_; }
+    void reorder_households();
+
+    // Per-year bookkeeping; takes effect at the next step()
+    void set_metrics_level(MetricsLevel level) { metrics_ = level; }
+    MetricsLevel metrics_level() const { return metrics_; }
+
+    // Access persons (ages are relative to year())
+    const PersonVector& persons() const { return people_; }
+    int32_t year() const { return year_; }
+    const std::vector<Couple>& couples() const { return couples_; }
+
+    // Metrics history (one entry per year advanced; with a retention set, only the
+    // recent full-resolution window, whose first entry is history_offset())
     const std::vector<double>& mean_age_history() const { return mean_age_hist_; }
     const std::vector<std::size_t>& population_history() const { return pop_hist_; }
     const std::vector<size_t>& births_history() const { return births_hist_; }
     const std::vector<size_t>& deaths_history() const { return deaths_hist_; }
+    // End-of-year state_hash() per year while the metrics level is Hash; with a retention
+    // set, only the recent window, whose first entry is hash number state_hash_offset()
+    const std::vector<uint64_t>& state_hash_history() const { return state_hash_hist_; }
+    uint64_t state_hash_offset() const { return state_hash_offset_; }
+    // Bounded history; set it before running, since changing it discards earlier
+    // summaries (entries still at full resolution are folded under the new shape).
+    // State hashes are not summarized; only the recent window of them is kept.
+    void set_history_retention(const HistoryRetention &retention);
+    const HistoryRetention &history_retention() const { return history_levels_.retention(); }
+    const HistoryLevels &history_levels() const { return history_levels_; }
+    uint64_t history_offset() const { return history_offset_; }
+
+    // Hash of people (as a set, so the layout does not matter), the couples table in
+    // wedding order, next id, year and RNG position; equal states hash equal, so two runs
+    // can be compared year by year through state_hash_history(). The people part is kept
+    // up to date as people change; the couples are hashed on each call, O(couples).
+    uint64_t state_hash() const;
 
     // RNG seeding
     void reseed(uint64_t seed);
 
+    // Draw logging, for debugging alternate engines against this one. Recording writes
+    // every random decision (phase, person id, raw draw, outcome) to `path`. Replaying
+    // takes the logged draws instead of the RNG and stops at the first draw whose phase,
+    // person or outcome differs; draw_mismatch() then describes it. Both throw
+    // std::runtime_error if the file cannot be opened.
+    void record_draws(const std::string &path);
+    void replay_draws(const std::string &path);
+    void stop_draws(); // flush and close the log
+    DrawMode draw_mode() const { return draws_.mode(); }
+    const DrawMismatch &draw_mismatch() const { return mismatch_; }
+
 private:
+    static constexpr uint32_t kNoSlot = std::numeric_limits<uint32_t>::max();
+    // Precompiled environment tables (see compile_environment)
+    static constexpr uint32_t kAgeBins = 128;   // same span as Environment::dying_curve
+    static constexpr uint8_t kCanMarry = 1u;    // >= age of consent
+    static constexpr uint8_t kCanConceive = 2u; // >= age of consent and inside the fertility window
+
+    // Per-year candidate bitsets over slots (bit i of word i/64 = people_[i]), built by one
+    // branch-free pass so phases enumerate candidates in O(popcount) instead of re-testing
+    struct EligibilityMasks {
+        explicit EligibilityMasks(ScratchArena &arena)
+            : single_female(ArenaAllocator<uint64_t>(arena)), single_male(ArenaAllocator<uint64_t>(arena)),
+              fertile_female(ArenaAllocator<uint64_t>(arena)), fertile_male(ArenaAllocator<uint64_t>(arena)) {}
+        ScratchVector<uint64_t> single_female;  // unmarried, >= age of consent
+        ScratchVector<uint64_t> single_male;
+        ScratchVector<uint64_t> fertile_female; // >= age of consent and in the fertility window
+        ScratchVector<uint64_t> fertile_male;
+    };
+
     Environment env_;
-    std::vector<Person> people_;
+    PersonVector people_;
     std::mt19937_64 rng_;
     uint64_t next_id_; // always < 2^63
+    int32_t year_;     // completed years; Person::age(year_) is the current age
+    std::vector<Couple> couples_;   // one entry per living married pair, in wedding order
+    uint64_t people_hash_;           // sum of person_hash() over people_ (see state_hash)
+    bool id_ordered_;                // people_ is in ascending id order (no reorder since)
+    std::vector<uint32_t> by_id_;    // otherwise: slots in ascending id order
+    PersonVector newborns_;          // this year's births, appended to people_ after conception
+    PersonVector spare_;             // survivors buffer, swapped with people_ every year
+    ScratchArena scratch_;           // backs all per-year temporaries; reset at the start of a year
+    uint64_t death_threshold_[kAgeBins];     // die iff rng_() < threshold
+    uint8_t eligibility_[2][kAgeBins];       // [gender][age] -> kCanMarry | kCanConceive
+    MetricsLevel metrics_;
+    uint32_t reorder_interval_;      // years between household reorders (0 = never)
+    unsigned threads_;               // worker threads for parallel phases (1 = serial)
 
     size_t births_this_year;
     size_t deaths_this_year;
@@ -92,16 +352,123 @@ private:
     std::vector<std::size_t> pop_hist_;
     std::vector<size_t> births_hist_;
     std::vector<size_t> deaths_hist_;
+    std::vector<uint64_t> state_hash_hist_;
+    HistoryLevels history_levels_;
+    uint64_t history_offset_;      // entries folded out of the recent window
+    uint64_t state_hash_offset_;   // state hashes dropped from the front of the window
+    void trim_history();
+
+    // draw log (record / replay)
+    DrawLog draws_;
+    DrawMismatch mismatch_;
+
+    std::unique_ptr<PerfCounters> perf_; // null unless enabled
+    std::unique_ptr<Tracer> tracer_;     // null unless enabled
+    bool instrumented_;                  // perf_ || tracer_
+    uint64_t phase_start_ns_;
+
+    std::unique_ptr<SnapshotPublisher> snapshots_; // null unless enabled
+    std::unique_ptr<SnapshotSeriesWriter> series_; // null unless recording
+    std::unique_ptr<SharedExporter> shared_;       // null unless sharing
+    void publish_snapshot();
+
+    // year observers
+    struct ObserverSlot {
+        uint64_t id;
+        YearObserver fn;
+        void *user;
+    };
+    std::vector<ObserverSlot> observers_;
+    uint64_t next_observer_id_;
+    bool observer_stopped_;
+    bool notify_observers();
+
+    // memory accounting
+    MemoryUsage peak_memory_;
+    std::size_t memory_limit_;
+    std::string memory_checkpoint_;
+    bool memory_limit_hit_;
+    std::size_t births_prev_year_;   // births of the year before last (trend)
+    std::size_t weddings_this_year_; // weddings of the last year
+    std::size_t weddings_prev_year_;
+    uint32_t trend_years_;           // years behind the trends since the last reset (0..2)
+    double scratch_per_person_;      // last year's scratch bytes per person (0 = unknown)
+    void update_peak_memory();
+    // Next year's births and weddings, as used by forecast_memory()
+    void forecast_year(std::size_t &births, std::size_t &weddings) const;
 
     // helpers
+    void compile_environment();
+    // Map a probability to a threshold on raw rng_() output: draw < threshold <=> U(0,1) < p
+    static uint64_t probability_threshold(double p);
+    // Phase boundaries inside do_year; a single test when instrumentation is off
+    void phase_begin() {
+        if (instrumented_) instrument_begin();
+    }
+    void phase_end(YearPhase phase) {
+        if (instrumented_) instrument_end(phase);
+    }
+    void instrument_begin();
+    void instrument_end(YearPhase phase);
+    // Every random draw goes through these so it can be logged or replayed
+    uint64_t next_draw(DrawPhase phase, uint64_t person) {
+        return draws_.mode() == DrawMode::Off ? rng_() : logged_draw(phase, person);
+    }
+    // Yes/no decision: draw < threshold
+    bool decide(DrawPhase phase, uint64_t person, uint64_t threshold) {
+        return draws_.mode() == DrawMode::Off ? rng_() < threshold : logged_decision(phase, person, threshold);
+    }
+    uint64_t logged_draw(DrawPhase phase, uint64_t person);
+    bool logged_decision(DrawPhase phase, uint64_t person, uint64_t threshold);
+    bool replay_next(const DrawRecord &actual, DrawRecord &expected);
+    void note_mismatch(const DrawRecord &expected, const DrawRecord &actual);
+    // next_draw as a URBG (same range as rng_) for the std distributions
+    struct TaggedDraws {
+        using result_type = uint64_t;
+        static constexpr result_type min() { return std::mt19937_64::min(); }
+        static constexpr result_type max() { return std::mt19937_64::max(); }
+        result_type operator()() { return pop->next_draw(phase, person); }
+        Population *pop;
+        DrawPhase phase;
+        uint64_t person;
+    };
+    TaggedDraws draws_for(DrawPhase phase, uint64_t person) { return TaggedDraws{this, phase, person}; }
+    uint8_t eligibility(uint32_t gender, uint32_t age) const {
+        return age < kAgeBins ? eligibility_[gender != 0u][age] : eligibility_slow(gender, age);
+    }
+    uint8_t eligibility_slow(uint32_t gender, uint32_t age) const;
     bool incest_blocked(const Person &a, const Person &b) const;
     uint64_t make_marital_field(uint64_t partner_id) const { return (partner_id << 1) | 1ull; }
-    void do_year();
-    void age_and_maybe_die(std::vector<Person> &out);
-    void marriages();
-    void conceiving();
-    void polygamous_conceiving();
-    void add_child(uint32_t mother_idx, uint32_t father_idx);
+    // Per-person term of people_hash_; summing makes the total order-independent and lets
+    // births, deaths and marital changes update it in O(1)
+    static uint64_t person_hash(const Person &p);
+    void set_marital(Person &p, uint64_t marital) {
+        people_hash_ -= person_hash(p);
+        p.marital = marital;
+        people_hash_ += person_hash(p);
+    }
+    void rehash_people();
+    // Yearly tick specialised on the mode flags; step() picks one kernel per call
+    using YearKernel = void (Population::*)();
+    YearKernel select_year_kernel() const;
+    template <bool Polygamy, bool Mutate, MetricsLevel Metrics> void do_year();
+    // Returns the sum of survivor ages when Metrics != Off (0 otherwise)
+    template <MetricsLevel Metrics> double age_and_maybe_die(PersonVector &out);
+    void build_eligibility_masks(EligibilityMasks &masks) const;
+    // Call f(slot) for every slot set in `bits`, in canonical (ascending id) order
+    template <class Bits, class F> void for_each_in_id_order(const Bits &bits, F &&f) const;
+    // Recompute id_ordered_ / by_id_ after people_ was replaced
+    void rebuild_id_order();
+    void marriages(const EligibilityMasks &masks);
+    template <bool Mutate> void conceiving();
+    template <bool Mutate> void polygamous_conceiving(const EligibilityMasks &masks);
+    template <bool Mutate> void add_child(uint32_t mother_idx, uint32_t father_idx);
+    // Size the newborn buffer from last year's births / move newborns into people_
+    void begin_births();
+    void flush_births();
+    // Move couples to the slots given by slot_map (old slot -> new slot or kNoSlot),
+    // widowing survivors of dissolved pairs
+    void remap_couples(PersonVector &people, const ScratchVector<uint32_t> &slot_map);
 
     // NEW: helpers
     // Flip exactly k distinct bit positions across child's 128-bit genome
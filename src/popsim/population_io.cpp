@@ -0,0 +1,249 @@
+// Checkpoints: the complete simulation state in one binary file.
+//
+// Layout (native byte order and struct layout; a checkpoint is read back by the
+// same build on the same platform, which the header sizes verify):
+//   "PSCKPT03", u32 sizeof(Environment), u32 sizeof(Person), u32 sizeof(Couple),
+//   u32 sizeof(HistorySummary)
+//   Environment, i32 year, u64 next_id, u8 metrics level, u32 reorder interval,
+//   u64 births this year, u64 deaths this year, RNG state (u64 length + text),
+//   people, couples, then the five histories, each as u64 count + raw elements,
+//   HistoryRetention, u64 history offset, u64 state hash offset, u64 entries dropped,
+//   u64 level count and each summary level as u64 count + raw HistorySummary elements.
+// Compressed checkpoints start with "PSCKPZ03" and store people and couples with
+// the column codecs of column_codec.hpp; everything else is identical.
+#include "population.hpp"
+#include "column_codec.hpp"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+
+namespace popsim {
+
+static const char kCheckpointMagic[8] = {'P', 'S', 'C', 'K', 'P', 'T', '0', '3'};
+static const char kCompressedMagic[8] = {'P', 'S', 'C', 'K', 'P', 'Z', '0', '3'};
+
+// Stream into a growing byte vector
+class VectorStreamBuf : public std::streambuf {
+public:
+    explicit VectorStreamBuf(std::vector<char> &out) : out_(out) {}
+
+protected:
+    std::streamsize xsputn(const char *s, std::streamsize n) override {
+        out_.insert(out_.end(), s, s + n);
+        return n;
+    }
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) out_.push_back(traits_type::to_char_type(c));
+        return traits_type::not_eof(c);
+    }
+
+private:
+    std::vector<char> &out_;
+};
+
+// Stream over caller-owned memory, read in place
+class MemoryStreamBuf : public std::streambuf {
+public:
+    MemoryStreamBuf(const char *data, std::size_t size) {
+        char *p = const_cast<char *>(data); // get area only; never written
+        setg(p, p, p + size);
+    }
+};
+
+template <class T>
+static void put(std::ostream &out, const T &v) {
+    out.write(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+template <class T>
+static void get(std::istream &in, T &v) {
+    in.read(reinterpret_cast<char *>(&v), sizeof(T));
+    if (!in) throw std::runtime_error("truncated checkpoint");
+}
+
+template <class V>
+static void put_vector(std::ostream &out, const V &v) {
+    put(out, (uint64_t)v.size());
+    out.write(reinterpret_cast<const char *>(v.data()), (std::streamsize)(v.size() * sizeof(typename V::value_type)));
+}
+
+template <class V>
+static void get_vector(std::istream &in, V &v) {
+    uint64_t n;
+    get(in, n);
+    v.resize((std::size_t)n);
+    in.read(reinterpret_cast<char *>(v.data()), (std::streamsize)(v.size() * sizeof(typename V::value_type)));
+    if (!in) throw std::runtime_error("truncated checkpoint");
+}
+
+void Population::save_state(std::ostream &out, CheckpointFormat format) const {
+    const bool compressed = format == CheckpointFormat::Compressed;
+    out.write(compressed ? kCompressedMagic : kCheckpointMagic, sizeof(kCheckpointMagic));
+    put(out, (uint32_t)sizeof(Environment));
+    put(out, (uint32_t)sizeof(Person));
+    put(out, (uint32_t)sizeof(Couple));
+    put(out, (uint32_t)sizeof(HistorySummary));
+    put(out, env_);
+    put(out, year_);
+    put(out, next_id_);
+    put(out, (uint8_t)metrics_);
+    put(out, reorder_interval_);
+    put(out, (uint64_t)births_this_year);
+    put(out, (uint64_t)deaths_this_year);
+    std::ostringstream rng;
+    rng << rng_;
+    const std::string rng_text = rng.str();
+    put(out, (uint64_t)rng_text.size());
+    out.write(rng_text.data(), (std::streamsize)rng_text.size());
+    if (compressed) {
+        write_people_columns(out, people_, year_, threads_);
+        write_couples_columns(out, couples_, people_.size(), year_);
+    } else {
+        put_vector(out, people_);
+        put_vector(out, couples_);
+    }
+    put_vector(out, mean_age_hist_);
+    put_vector(out, pop_hist_);
+    put_vector(out, births_hist_);
+    put_vector(out, deaths_hist_);
+    put_vector(out, state_hash_hist_);
+    put(out, history_levels_.retention());
+    put(out, history_offset_);
+    put(out, state_hash_offset_);
+    put(out, history_levels_.dropped());
+    put(out, (uint64_t)history_levels_.level_count());
+    for (std::size_t i = 0; i < history_levels_.level_count(); ++i) put_vector(out, history_levels_.level(i));
+}
+
+void Population::load_state(std::istream &in) {
+    // parse everything into temporaries first: a truncated or corrupt stream throws
+    // and leaves this population as it was
+    char magic[sizeof(kCheckpointMagic)];
+    in.read(magic, sizeof(magic));
+    const bool compressed = in && std::memcmp(magic, kCompressedMagic, sizeof(magic)) == 0;
+    if (!in || (!compressed && std::memcmp(magic, kCheckpointMagic, sizeof(magic)) != 0)) {
+        throw std::runtime_error("not a popsim checkpoint");
+    }
+    uint32_t env_size, person_size, couple_size, summary_size;
+    get(in, env_size);
+    get(in, person_size);
+    get(in, couple_size);
+    get(in, summary_size);
+    if (env_size != sizeof(Environment) || person_size != sizeof(Person) || couple_size != sizeof(Couple) ||
+        summary_size != sizeof(HistorySummary)) {
+        throw std::runtime_error("checkpoint was written by an incompatible build");
+    }
+    Environment env;
+    get(in, env);
+    int32_t year;
+    uint64_t next_id;
+    uint8_t metrics;
+    uint32_t reorder_interval;
+    get(in, year);
+    get(in, next_id);
+    if (next_id >> 63) throw std::runtime_error("corrupt next id in checkpoint");
+    get(in, metrics);
+    if (metrics > (uint8_t)MetricsLevel::Hash) throw std::runtime_error("corrupt metrics level in checkpoint");
+    get(in, reorder_interval);
+    uint64_t births, deaths;
+    get(in, births);
+    get(in, deaths);
+    uint64_t rng_len;
+    get(in, rng_len);
+    std::string rng_text((std::size_t)rng_len, '\0');
+    in.read(&rng_text[0], (std::streamsize)rng_len);
+    std::istringstream rng_in(rng_text);
+    std::mt19937_64 rng;
+    rng_in >> rng;
+    if (!in || !rng_in) throw std::runtime_error("corrupt RNG state in checkpoint");
+    PersonVector people(people_.get_allocator());
+    std::vector<Couple> couples;
+    if (compressed) {
+        read_people_columns(in, people, year, threads_);
+        read_couples_columns(in, couples, people, year);
+    } else {
+        get_vector(in, people);
+        get_vector(in, couples);
+        for (const Couple &c : couples) {
+            if (c.mother >= people.size() || c.father >= people.size()) {
+                throw std::runtime_error("corrupt checkpoint couples");
+            }
+        }
+    }
+    std::vector<double> mean_age_hist;
+    std::vector<std::size_t> pop_hist, births_hist, deaths_hist;
+    std::vector<uint64_t> state_hash_hist;
+    get_vector(in, mean_age_hist);
+    get_vector(in, pop_hist);
+    get_vector(in, births_hist);
+    get_vector(in, deaths_hist);
+    get_vector(in, state_hash_hist);
+    HistoryRetention retention;
+    uint64_t history_offset, state_hash_offset;
+    get(in, retention);
+    get(in, history_offset);
+    get(in, state_hash_offset);
+    uint64_t dropped, level_count;
+    get(in, dropped);
+    get(in, level_count);
+    if (level_count > retention.levels) throw std::runtime_error("corrupt history levels in checkpoint");
+    std::vector<std::vector<HistorySummary>> levels((std::size_t)level_count);
+    for (auto &l : levels) get_vector(in, l);
+
+    // commit; nothing below throws
+    year_ = year;
+    next_id_ = next_id;
+    metrics_ = (MetricsLevel)metrics;
+    reorder_interval_ = reorder_interval;
+    births_this_year = (size_t)births;
+    deaths_this_year = (size_t)deaths;
+    trend_years_ = 0; // the forecast bounds the first year after a load
+    scratch_per_person_ = 0.0;
+    rng_ = rng;
+    people_.swap(people);
+    couples_.swap(couples);
+    mean_age_hist_.swap(mean_age_hist);
+    pop_hist_.swap(pop_hist);
+    births_hist_.swap(births_hist);
+    deaths_hist_.swap(deaths_hist);
+    state_hash_hist_.swap(state_hash_hist);
+    history_offset_ = history_offset;
+    state_hash_offset_ = state_hash_offset;
+    history_levels_.configure(retention);
+    history_levels_.restore(std::move(levels), dropped);
+    rebuild_id_order();
+    rehash_people();
+    set_environment(env);
+}
+
+void Population::serialize(std::vector<char> &out, CheckpointFormat format) const {
+    out.clear();
+    out.reserve(people_.size() * sizeof(Person) + couples_.size() * sizeof(Couple) + 4096);
+    VectorStreamBuf buf(out);
+    std::ostream stream(&buf);
+    save_state(stream, format);
+}
+
+void Population::deserialize(const char *data, std::size_t size) {
+    MemoryStreamBuf buf(data, size);
+    std::istream stream(&buf);
+    load_state(stream);
+}
+
+void Population::save_checkpoint(const std::string &path, CheckpointFormat format) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("cannot open checkpoint for writing: " + path);
+    save_state(out, format);
+    out.flush();
+    if (!out) throw std::runtime_error("failed writing checkpoint: " + path);
+}
+
+void Population::load_checkpoint(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("cannot open checkpoint: " + path);
+    load_state(in);
+}
+
+} // namespace popsim
@@ -0,0 +1,116 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace popsim {
+
+// Bump allocator for per-year scratch storage. Allocations are never freed
+// individually; reset() rewinds the arena and, if the year spilled into more
+// than one block, coalesces them so the next year fits in a single block.
+// In steady state a year therefore performs no heap allocation at all.
+class ScratchArena {
+public:
+    ScratchArena() : used_(0), requested_(0), heap_allocations_(0) {}
+    ScratchArena(const ScratchArena &) = delete;
+    ScratchArena &operator=(const ScratchArena &) = delete;
+
+    void *allocate(std::size_t bytes, std::size_t align) {
+        if (!blocks_.empty()) {
+            Block &b = blocks_.back();
+            std::size_t off = (used_ + align - 1) & ~(align - 1);
+            if (off + bytes <= b.size) {
+                requested_ += off + bytes - used_;
+                used_ = off + bytes;
+                return b.data.get() + off;
+            }
+        }
+        // spill: open a block at least twice the current capacity
+        std::size_t size = std::max<std::size_t>(bytes + align, std::max<std::size_t>(2 * capacity(), kMinBlock));
+        add_block(size);
+        std::size_t off = (used_ + align - 1) & ~(align - 1);
+        used_ = off + bytes;
+        requested_ += used_;
+        return blocks_.back().data.get() + off;
+    }
+
+    // Rewind; only valid once every container using the arena is gone
+    void reset() {
+        if (blocks_.size() > 1) {
+            std::size_t total = capacity();
+            blocks_.clear();
+            add_block(total);
+        }
+        used_ = 0;
+        requested_ = 0;
+    }
+
+    std::size_t capacity() const {
+        std::size_t total = 0;
+        for (const auto &b : blocks_) total += b.size;
+        return total;
+    }
+    // Bytes handed out since the last reset, alignment included (what a single block
+    // would need to hold them)
+    std::size_t requested() const { return requested_; }
+    // Capacity of an arena of `capacity` bytes after a reset and `bytes` of requests, by
+    // the spill rule above; an upper bound, since it assumes no request fits the blocks
+    // before the newest
+    static std::size_t capacity_after(std::size_t capacity, std::size_t bytes) {
+        std::size_t total = capacity, block = total;
+        while (block < bytes) {
+            block = std::max<std::size_t>(2 * total, kMinBlock);
+            total += block;
+        }
+        return total;
+    }
+    // Number of blocks ever requested from the heap
+    std::size_t heap_allocations() const { return heap_allocations_; }
+
+private:
+    static constexpr std::size_t kMinBlock = 64 * 1024;
+
+    struct Block {
+        std::unique_ptr<unsigned char[]> data;
+        std::size_t size;
+    };
+
+    void add_block(std::size_t size) {
+        // operator new[] returns memory aligned for any fundamental type
+        blocks_.push_back(Block{std::unique_ptr<unsigned char[]>(new unsigned char[size]), size});
+        used_ = 0;
+        ++heap_allocations_;
+    }
+
+    std::vector<Block> blocks_;
+    std::size_t used_; // bytes used in blocks_.back()
+    std::size_t requested_;
+    std::size_t heap_allocations_;
+};
+
+// std allocator adaptor so standard containers can live in a ScratchArena
+template <class T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    explicit ArenaAllocator(ScratchArena &arena) : arena(&arena) {}
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(std::size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *, std::size_t) {} // released wholesale by ScratchArena::reset
+
+    template <class U>
+    bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+    template <class U>
+    bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+
+    ScratchArena *arena;
+};
+
+template <class T>
+using ScratchVector = std::vector<T, ArenaAllocator<T>>;
+
+} // namespace popsim
@@ -0,0 +1,289 @@
+#include "series.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace popsim {
+
+static const char kSeriesMagic[8] = {'P', 'S', 'S', 'E', 'R', 'I', '0', '1'};
+static constexpr std::size_t kRecordHeaderBytes = 13; // kind, year, payload bytes
+static constexpr uint8_t kKeyframe = 0;
+static constexpr uint8_t kDelta = 1;
+
+static void put_fixed(std::vector<uint8_t> &out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i) out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+static uint64_t get_fixed(const uint8_t *in, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) v |= (uint64_t)in[i] << (8 * i);
+    return v;
+}
+
+static void put_varint(std::vector<uint8_t> &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+static int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+// Bounds-checked cursor over a record payload
+struct PayloadReader {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p == end) throw std::runtime_error("truncated snapshot series record");
+            const uint8_t b = *p++;
+            v |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        throw std::runtime_error("corrupt varint in snapshot series");
+    }
+    uint64_t fixed(int bytes) {
+        if (end - p < bytes) throw std::runtime_error("truncated snapshot series record");
+        const uint64_t v = get_fixed(p, bytes);
+        p += bytes;
+        return v;
+    }
+};
+
+SnapshotSeriesWriter::SnapshotSeriesWriter(const std::string &path, uint32_t keyframe_interval)
+    : file_(std::fopen(path.c_str(), "wb")), path_(path), keyframe_interval_(keyframe_interval), since_keyframe_(0),
+      first_new_id_(0), bytes_(0) {
+    if (!file_) throw std::runtime_error("cannot open snapshot series for writing: " + path);
+    std::vector<uint8_t> header(kSeriesMagic, kSeriesMagic + sizeof(kSeriesMagic));
+    put_fixed(header, sizeof(Person), 4);
+    try {
+        write_bytes(header.data(), header.size());
+    } catch (...) {
+        std::fclose(file_);
+        throw;
+    }
+    bytes_ = header.size();
+}
+
+SnapshotSeriesWriter::~SnapshotSeriesWriter() {
+    if (file_) std::fclose(file_);
+}
+
+void SnapshotSeriesWriter::close() {
+    std::FILE *file = file_;
+    file_ = nullptr;
+    if (file && std::fclose(file) != 0) throw std::runtime_error("failed writing snapshot series: " + path_);
+}
+
+void SnapshotSeriesWriter::write_bytes(const void *data, std::size_t size) {
+    if (std::fwrite(data, 1, size, file_) != size) throw std::runtime_error("failed writing snapshot series: " + path_);
+}
+
+void SnapshotSeriesWriter::write_record(uint8_t kind, int32_t year, const std::vector<uint8_t> &payload) {
+    std::vector<uint8_t> header;
+    header.push_back(kind);
+    put_fixed(header, (uint32_t)year, 4);
+    put_fixed(header, payload.size(), 8);
+    write_bytes(header.data(), header.size());
+    write_bytes(payload.data(), payload.size());
+    // a reader opening the series mid-run sees every finished record
+    if (std::fflush(file_) != 0) throw std::runtime_error("failed writing snapshot series: " + path_);
+    bytes_ += header.size() + payload.size();
+}
+
+void SnapshotSeriesWriter::write_keyframe(const Population &pop) {
+    const PersonVector &people = pop.persons();
+    std::vector<Person> sorted(people.begin(), people.end());
+    auto by_id = [](const Person &a, const Person &b) { return a.id < b.id; };
+    if (!std::is_sorted(sorted.begin(), sorted.end(), by_id)) std::sort(sorted.begin(), sorted.end(), by_id);
+    payload_.clear();
+    put_fixed(payload_, sorted.size(), 8);
+    const uint8_t *raw = reinterpret_cast<const uint8_t *>(sorted.data());
+    payload_.insert(payload_.end(), raw, raw + sorted.size() * sizeof(Person));
+    write_record(kKeyframe, pop.year(), payload_);
+    since_keyframe_ = 0;
+}
+
+void SnapshotSeriesWriter::end_year(const Population &pop) {
+    if (keyframe_interval_ != 0 && ++since_keyframe_ >= keyframe_interval_) {
+        write_keyframe(pop);
+        return;
+    }
+    const int32_t year = pop.year();
+    const PersonVector &people = pop.persons();
+    payload_.clear();
+
+    // deaths of people alive at the previous record (newborns that died never appeared)
+    died_.erase(std::remove_if(died_.begin(), died_.end(), [this](uint64_t id) { return id >= first_new_id_; }),
+                died_.end());
+    std::sort(died_.begin(), died_.end());
+    put_varint(payload_, died_.size());
+    uint64_t prev = 0;
+    for (uint64_t id : died_) {
+        put_varint(payload_, id - prev);
+        prev = id;
+    }
+
+    // weddings of the year sit at the tail of the couples table; those broken by a
+    // death within the year are gone from it, and replaying them would change nothing
+    std::vector<std::pair<uint64_t, uint64_t>> weddings;
+    const std::vector<Couple> &couples = pop.couples();
+    for (std::size_t k = couples.size(); k > 0 && couples[k - 1].married_year == year - 1; --k) {
+        weddings.emplace_back(people[couples[k - 1].mother].id, people[couples[k - 1].father].id);
+    }
+    std::sort(weddings.begin(), weddings.end());
+    put_varint(payload_, weddings.size());
+    prev = 0;
+    for (const auto &w : weddings) {
+        put_varint(payload_, w.first - prev);
+        put_varint(payload_, zigzag((int64_t)(w.second - w.first)));
+        prev = w.first;
+    }
+
+    // births: everyone with an id issued this year
+    std::vector<const Person *> born;
+    for (const Person &p : people) {
+        if (p.id >= first_new_id_) born.push_back(&p);
+    }
+    std::sort(born.begin(), born.end(), [](const Person *a, const Person *b) { return a->id < b->id; });
+    put_varint(payload_, born.size());
+    prev = 0;
+    for (const Person *p : born) {
+        put_varint(payload_, p->id - prev);
+        put_fixed(payload_, p->g0, 8);
+        put_fixed(payload_, p->g1, 8);
+        put_varint(payload_, zigzag((int64_t)p->birth_year - year));
+        put_varint(payload_, p->gender);
+        put_varint(payload_, p->marital);
+        prev = p->id;
+    }
+    write_record(kDelta, year, payload_);
+}
+
+SnapshotSeriesReader::SnapshotSeriesReader(const std::string &path) : file_(std::fopen(path.c_str(), "rb")) {
+    if (!file_) throw std::runtime_error("cannot open snapshot series: " + path);
+    uint8_t header[sizeof(kSeriesMagic) + 4];
+    if (std::fread(header, 1, sizeof(header), file_) != sizeof(header) ||
+        !std::equal(kSeriesMagic, kSeriesMagic + sizeof(kSeriesMagic), reinterpret_cast<const char *>(header))) {
+        std::fclose(file_);
+        throw std::runtime_error("not a popsim snapshot series: " + path);
+    }
+    if (get_fixed(header + sizeof(kSeriesMagic), 4) != sizeof(Person)) {
+        std::fclose(file_);
+        throw std::runtime_error("snapshot series was written by an incompatible build: " + path);
+    }
+    uint64_t offset = sizeof(header);
+    uint8_t rh[kRecordHeaderBytes];
+    // a partly written last record (interrupted run) is ignored
+    while (std::fread(rh, 1, sizeof(rh), file_) == sizeof(rh)) {
+        Record r;
+        r.kind = rh[0];
+        r.year = (int32_t)(uint32_t)get_fixed(rh + 1, 4);
+        r.bytes = get_fixed(rh + 5, 8);
+        r.offset = offset + sizeof(rh);
+        if (std::fseek(file_, (long)r.bytes, SEEK_CUR) != 0) break;
+        offset = r.offset + r.bytes;
+        records_.push_back(r);
+    }
+    // drop a record whose payload runs past the end of the file
+    if (std::fseek(file_, 0, SEEK_END) == 0) {
+        const uint64_t size = (uint64_t)std::ftell(file_);
+        while (!records_.empty() && records_.back().offset + records_.back().bytes > size) records_.pop_back();
+    }
+}
+
+SnapshotSeriesReader::~SnapshotSeriesReader() { std::fclose(file_); }
+
+std::vector<int32_t> SnapshotSeriesReader::years() const {
+    std::vector<int32_t> out;
+    out.reserve(records_.size());
+    for (const Record &r : records_) out.push_back(r.year);
+    return out;
+}
+
+std::vector<uint8_t> SnapshotSeriesReader::load(const Record &r) const {
+    std::vector<uint8_t> payload((std::size_t)r.bytes);
+    if (std::fseek(file_, (long)r.offset, SEEK_SET) != 0 ||
+        std::fread(payload.data(), 1, payload.size(), file_) != payload.size()) {
+        throw std::runtime_error("failed reading snapshot series record");
+    }
+    return payload;
+}
+
+static Person *find_person(std::vector<Person> &people, uint64_t id) {
+    auto it = std::lower_bound(people.begin(), people.end(), id,
+                               [](const Person &p, uint64_t v) { return p.id < v; });
+    return it != people.end() && it->id == id ? &*it : nullptr;
+}
+
+static void apply_delta(std::vector<Person> &people, const std::vector<uint8_t> &payload, int32_t year) {
+    PayloadReader in{payload.data(), payload.data() + payload.size()};
+    std::vector<uint64_t> dead((std::size_t)in.varint());
+    uint64_t id = 0;
+    for (auto &d : dead) d = id += in.varint();
+
+    const uint64_t weddings = in.varint();
+    id = 0;
+    for (uint64_t k = 0; k < weddings; ++k) {
+        const uint64_t wife = id += in.varint();
+        const uint64_t husband = wife + (uint64_t)unzigzag(in.varint());
+        Person *w = find_person(people, wife);
+        Person *h = find_person(people, husband);
+        if (!w || !h) throw std::runtime_error("snapshot series delta marries unknown people");
+        w->marital = (husband << 1) | 1ull;
+        h->marital = (wife << 1) | 1ull;
+    }
+
+    std::size_t kept = 0;
+    std::size_t d = 0;
+    for (const Person &p : people) {
+        while (d < dead.size() && dead[d] < p.id) ++d;
+        if (d < dead.size() && dead[d] == p.id) continue;
+        people[kept++] = p;
+    }
+    people.resize(kept);
+    for (Person &p : people) {
+        if (p.married() && std::binary_search(dead.begin(), dead.end(), p.partner_id())) p.marital = 0ull;
+    }
+
+    const uint64_t births = in.varint();
+    id = 0;
+    for (uint64_t k = 0; k < births; ++k) {
+        Person p{};
+        p.id = id += in.varint();
+        p.g0 = in.fixed(8);
+        p.g1 = in.fixed(8);
+        p.birth_year = (int32_t)(year + unzigzag(in.varint()));
+        p.gender = (uint32_t)in.varint();
+        p.marital = in.varint();
+        people.push_back(p);
+    }
+}
+
+std::vector<Person> SnapshotSeriesReader::read(int32_t year) const {
+    std::size_t target = records_.size();
+    for (std::size_t i = 0; i < records_.size(); ++i) {
+        if (records_[i].year == year) target = i;
+    }
+    if (target == records_.size()) throw std::out_of_range("year not in snapshot series");
+    std::size_t key = target;
+    while (records_[key].kind != kKeyframe) {
+        if (key == 0) throw std::runtime_error("snapshot series has no keyframe before the year");
+        --key;
+    }
+    std::vector<uint8_t> payload = load(records_[key]);
+    PayloadReader in{payload.data(), payload.data() + payload.size()};
+    const uint64_t n = in.fixed(8);
+    if ((uint64_t)(in.end - in.p) != n * sizeof(Person)) throw std::runtime_error("corrupt snapshot series keyframe");
+    std::vector<Person> people((std::size_t)n);
+    std::copy(in.p, in.end, reinterpret_cast<uint8_t *>(people.data()));
+    for (std::size_t i = key + 1; i <= target; ++i) {
+        if (records_[i].kind != kDelta) throw std::runtime_error("corrupt snapshot series record");
+        apply_delta(people, load(records_[i]), records_[i].year);
+    }
+    return people;
+}
+
+} // namespace popsim
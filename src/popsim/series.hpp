@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "population.hpp"
+
+namespace popsim {
+
+// Snapshot series: one file holding the population at every year of a run as
+// keyframes (full state) plus compact per-year deltas built from the year's events.
+//
+// File: "PSSERI01", u32 sizeof(Person), then records of
+//   u8 kind (0 keyframe, 1 delta), i32 year, u64 payload bytes, payload
+// Keyframe payload: u64 count, Person[count] in ascending id order.
+// Delta payload (all varints LEB128, ids as gaps from the previous id in the list):
+//   removed ids (deaths of people alive at the previous record), ascending;
+//   marriages as (wife id gap, zigzag(husband - wife)), wives ascending;
+//   births as (id gap, g0 and g1 as raw little-endian u64, zigzag(birth_year - year),
+//   gender, marital), ascending.
+// Replaying a delta: apply marriages, drop the dead and widow their partners, append
+// births. Reconstructed populations are in ascending id order, which can differ from
+// the live slot order (see Population::set_reorder_interval) but not in content.
+class SnapshotSeriesWriter {
+public:
+    // Throws std::runtime_error if the file cannot be opened; every record is flushed
+    // as it is appended, and a failed write throws as well
+    SnapshotSeriesWriter(const std::string &path, uint32_t keyframe_interval);
+    ~SnapshotSeriesWriter();
+    SnapshotSeriesWriter(const SnapshotSeriesWriter &) = delete;
+    SnapshotSeriesWriter &operator=(const SnapshotSeriesWriter &) = delete;
+
+    void write_keyframe(const Population &pop);
+    // Event hooks around one simulated year
+    void begin_year(uint64_t first_new_id) {
+        first_new_id_ = first_new_id;
+        died_.clear();
+    }
+    void died(uint64_t id) { died_.push_back(id); }
+    void end_year(const Population &pop);
+
+    // Throws std::runtime_error if the file could not be closed cleanly
+    void close();
+
+    uint64_t bytes_written() const { return bytes_; }
+
+private:
+    void write_bytes(const void *data, std::size_t size);
+    void write_record(uint8_t kind, int32_t year, const std::vector<uint8_t> &payload);
+
+    std::FILE *file_;
+    std::string path_;
+    uint32_t keyframe_interval_;
+    uint32_t since_keyframe_;
+    uint64_t first_new_id_;
+    uint64_t bytes_;
+    std::vector<uint64_t> died_;
+    std::vector<uint8_t> payload_; // reused record buffer
+};
+
+// Random access to a snapshot series: the record index is built on open, and a year
+// is rebuilt from the nearest keyframe at or before it
+class SnapshotSeriesReader {
+public:
+    // Throws std::runtime_error if the file cannot be read or is not a series
+    explicit SnapshotSeriesReader(const std::string &path);
+    ~SnapshotSeriesReader();
+    SnapshotSeriesReader(const SnapshotSeriesReader &) = delete;
+    SnapshotSeriesReader &operator=(const SnapshotSeriesReader &) = delete;
+
+    // Years with a record, ascending
+    std::vector<int32_t> years() const;
+    // Population at `year`, ascending by id; throws std::out_of_range if absent
+    std::vector<Person> read(int32_t year) const;
+
+private:
+    struct Record {
+        uint8_t kind;
+        int32_t year;
+        uint64_t offset; // of the payload
+        uint64_t bytes;
+    };
+    std::vector<uint8_t> load(const Record &r) const;
+
+    std::FILE *file_;
+    std::vector<Record> records_;
+};
+
+} // namespace popsim
@@ -0,0 +1,186 @@
+#include "shared_export.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include "parallel.hpp"
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace popsim {
+
+std::string shared_segment_name(const std::string &name) {
+    if (name.empty() || name.find('/', 1) != std::string::npos || name == "/") {
+        throw std::invalid_argument("shared-memory name must be non-empty and contain no '/' after the first");
+    }
+    return name[0] == '/' ? name : "/" + name;
+}
+
+#if defined(_WIN32)
+// No POSIX shared memory: sharing is unavailable, everything else works
+SharedExporter::SharedExporter(const std::string &name, bool)
+    : name_(shared_segment_name(name)), base_(nullptr), bytes_(0), published_(0) {
+    throw std::runtime_error("shared-memory export is not supported on this platform");
+}
+
+SharedExporter::~SharedExporter() {}
+
+void SharedExporter::publish(int32_t, const Person *, std::size_t, unsigned) {}
+
+SharedReader::SharedReader(const std::string &) : base_(nullptr), bytes_(0) {
+    throw std::runtime_error("shared-memory export is not supported on this platform");
+}
+
+SharedReader::~SharedReader() {}
+#else
+static const char kSharedMagic[8] = {'P', 'S', 'S', 'H', 'A', 'R', 'E', '\0'};
+static constexpr std::size_t kSharedAlign = 64;
+static constexpr std::size_t kPublishChunk = std::size_t(1) << 16;
+static constexpr uint32_t kColumnWidth[kSharedColumns] = {8, 8, 8, 4, 8, 4};
+
+static std::size_t align_up(std::size_t v) { return (v + kSharedAlign - 1) / kSharedAlign * kSharedAlign; }
+
+static std::runtime_error shared_error(const char *what, const std::string &name) {
+    return std::runtime_error(std::string(what) + " " + name + ": " + std::strerror(errno));
+}
+
+SharedExporter::SharedExporter(const std::string &name, bool replace)
+    : name_(shared_segment_name(name)), base_(nullptr), bytes_(0), published_(0) {
+    const Mapping m = create(1024, replace);
+    base_ = m.base;
+    bytes_ = m.bytes;
+}
+
+SharedExporter::~SharedExporter() { release(true); }
+
+void SharedExporter::release(bool unlink) {
+    if (base_) ::munmap(base_, bytes_);
+    base_ = nullptr;
+    bytes_ = 0;
+    if (unlink) ::shm_unlink(name_.c_str());
+}
+
+SharedExporter::Mapping SharedExporter::create(uint64_t capacity, bool replace) {
+    if (replace) ::shm_unlink(name_.c_str());
+    const int fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 && errno == EEXIST) throw std::runtime_error("shared memory segment already exists: " + name_);
+    if (fd < 0) throw shared_error("cannot create shared memory", name_);
+
+    uint64_t column_offset[kSharedColumns];
+    std::size_t slot_bytes = 0;
+    for (std::size_t c = 0; c < kSharedColumns; ++c) {
+        column_offset[c] = slot_bytes;
+        slot_bytes += align_up(capacity * kColumnWidth[c]);
+    }
+    const std::size_t data_offset = align_up(sizeof(SharedHeader));
+    const std::size_t bytes = data_offset + 2 * slot_bytes;
+    if (::ftruncate(fd, (off_t)bytes) != 0) {
+        ::close(fd);
+        ::shm_unlink(name_.c_str());
+        throw shared_error("cannot size shared memory", name_);
+    }
+    void *base = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        ::shm_unlink(name_.c_str());
+        throw shared_error("cannot map shared memory", name_);
+    }
+
+    // ftruncate zero-fills, so the slots start out unwritten
+    SharedHeader *h = new (base) SharedHeader();
+    std::memcpy(h->magic, kSharedMagic, sizeof(kSharedMagic));
+    h->version = kSharedLayoutVersion;
+    h->header_bytes = sizeof(SharedHeader);
+    h->capacity = capacity;
+    h->data_offset = data_offset;
+    h->slot_bytes = slot_bytes;
+    for (std::size_t c = 0; c < kSharedColumns; ++c) {
+        h->column_offset[c] = column_offset[c];
+        h->column_width[c] = kColumnWidth[c];
+    }
+    h->published.store(0, std::memory_order_relaxed);
+    h->writing.store(0, std::memory_order_relaxed);
+    h->retired.store(0, std::memory_order_release);
+    return Mapping{base, bytes};
+}
+
+void SharedExporter::publish(int32_t year, const Person *people, std::size_t n, unsigned threads) {
+    const uint64_t seq = ++published_;
+    const uint64_t capacity = static_cast<const SharedHeader *>(base_)->capacity;
+    if (n <= capacity) {
+        write(Mapping{base_, bytes_}, seq, year, people, n, threads);
+        return;
+    }
+    // the larger segment holds this publication before the old one is retired, so
+    // readers that reopen find data; they keep the old mapping until then
+    const Mapping grown = create(std::max<uint64_t>(n, 2 * capacity), true);
+    write(grown, seq, year, people, n, threads);
+    static_cast<SharedHeader *>(base_)->retired.store(1, std::memory_order_release);
+    release(false);
+    base_ = grown.base;
+    bytes_ = grown.bytes;
+}
+
+void SharedExporter::write(const Mapping &m, uint64_t seq, int32_t year, const Person *people, std::size_t n,
+                           unsigned threads) {
+    SharedHeader *h = static_cast<SharedHeader *>(m.base);
+    h->writing.store(seq, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    SharedSlot &slot = h->slots[seq & 1];
+    uint8_t *data = static_cast<uint8_t *>(m.base) + h->data_offset + (seq & 1) * h->slot_bytes;
+    uint64_t *id = reinterpret_cast<uint64_t *>(data + h->column_offset[(int)SharedColumn::Id]);
+    uint64_t *g0 = reinterpret_cast<uint64_t *>(data + h->column_offset[(int)SharedColumn::G0]);
+    uint64_t *g1 = reinterpret_cast<uint64_t *>(data + h->column_offset[(int)SharedColumn::G1]);
+    int32_t *birth_year = reinterpret_cast<int32_t *>(data + h->column_offset[(int)SharedColumn::BirthYear]);
+    uint64_t *marital = reinterpret_cast<uint64_t *>(data + h->column_offset[(int)SharedColumn::Marital]);
+    uint32_t *gender = reinterpret_cast<uint32_t *>(data + h->column_offset[(int)SharedColumn::Gender]);
+    parallel_for((n + kPublishChunk - 1) / kPublishChunk, threads, [&](std::size_t c) {
+        const std::size_t lo = c * kPublishChunk, hi = std::min(n, lo + kPublishChunk);
+        for (std::size_t i = lo; i < hi; ++i) {
+            const Person &p = people[i];
+            id[i] = p.id;
+            g0[i] = p.g0;
+            g1[i] = p.g1;
+            birth_year[i] = p.birth_year;
+            marital[i] = p.marital;
+            gender[i] = p.gender;
+        }
+    });
+    slot.sequence = seq;
+    slot.count = n;
+    slot.year = year;
+    h->published.store(seq, std::memory_order_release);
+}
+
+SharedReader::SharedReader(const std::string &name) : base_(nullptr), bytes_(0) {
+    const std::string path = shared_segment_name(name);
+    const int fd = ::shm_open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0) throw shared_error("cannot open shared memory", path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw shared_error("cannot stat shared memory", path);
+    }
+    bytes_ = (std::size_t)st.st_size;
+    void *base = bytes_ >= sizeof(SharedHeader) ? ::mmap(nullptr, bytes_, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (base == MAP_FAILED) throw std::runtime_error("cannot map shared memory " + path);
+    base_ = base;
+    const SharedHeader &h = header();
+    if (std::memcmp(h.magic, kSharedMagic, sizeof(kSharedMagic)) != 0 || h.version != kSharedLayoutVersion ||
+        h.header_bytes != sizeof(SharedHeader) || h.data_offset + 2 * h.slot_bytes > bytes_) {
+        ::munmap(base_, bytes_);
+        throw std::runtime_error("not a compatible popsim shared segment: " + path);
+    }
+}
+
+SharedReader::~SharedReader() { ::munmap(base_, bytes_); }
+
+#endif
+
+} // namespace popsim
@@ -0,0 +1,119 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "population.hpp"
+
+namespace popsim {
+
+// Columnar population published in a named POSIX shared-memory segment, for
+// readers in other processes.
+//
+// The segment is a SharedHeader followed (64-byte aligned) by two slots of
+// `capacity` persons, each holding the columns below at column_offset[] from the
+// slot start. Publications alternate slots: publication s lives in slot s & 1. The
+// writer stores `writing` = s before touching the slot and `published` = s (release)
+// once it is complete, so data read from publication s is intact if, after reading
+// (acquire fence), `writing` is still below s + 2 (a seqlock over two slots), and the
+// slot's `sequence` is s. When the population outgrows the capacity, the writer creates
+// a larger segment under the same name, publishes into it, and only then sets `retired`
+// in the old one; readers then reopen by name. Numbering continues across segments.
+// Layout changes bump kSharedLayoutVersion. POSIX only (elsewhere the exporter and
+// reader constructors throw std::runtime_error); owner read/write access.
+enum class SharedColumn : uint32_t { Id = 0, G0, G1, BirthYear, Marital, Gender, Count };
+constexpr std::size_t kSharedColumns = (std::size_t)SharedColumn::Count;
+constexpr uint32_t kSharedLayoutVersion = 1;
+
+struct SharedSlot {
+    uint64_t sequence; // publication held (0 = never written)
+    uint64_t count;    // persons
+    int32_t year;      // Population::year(); ages are year - birth_year
+    uint32_t reserved;
+};
+
+struct SharedHeader {
+    char magic[8];                          // "PSSHARE\0"
+    uint32_t version;                       // kSharedLayoutVersion
+    uint32_t header_bytes;                  // sizeof(SharedHeader)
+    uint64_t capacity;                      // persons per slot
+    uint64_t data_offset;                   // first slot, from the segment start
+    uint64_t slot_bytes;
+    uint64_t column_offset[kSharedColumns]; // from the slot start
+    uint32_t column_width[kSharedColumns];  // bytes per element
+    std::atomic<uint64_t> published;        // latest complete publication (0 = none)
+    std::atomic<uint64_t> writing;          // publication being written (or last written)
+    std::atomic<uint32_t> retired;          // superseded by a larger segment
+    uint32_t reserved;
+    SharedSlot slots[2];
+};
+
+// Writer side, owned by a Population; unlinks the name when destroyed
+class SharedExporter {
+public:
+    // Throws std::runtime_error if the segment cannot be created, including when the
+    // name is taken; replace = true first removes a segment of that name (one left
+    // behind by a crashed writer)
+    explicit SharedExporter(const std::string &name, bool replace = false);
+    ~SharedExporter();
+    SharedExporter(const SharedExporter &) = delete;
+    SharedExporter &operator=(const SharedExporter &) = delete;
+
+    void publish(int32_t year, const Person *people, std::size_t n, unsigned threads);
+    const std::string &name() const { return name_; }
+
+private:
+    struct Mapping {
+        void *base;
+        std::size_t bytes;
+    };
+    // Create an empty segment of `capacity` persons per slot under name_, first
+    // unlinking what is there when `replace` (our own segment, when growing)
+    Mapping create(uint64_t capacity, bool replace);
+    void write(const Mapping &m, uint64_t seq, int32_t year, const Person *people, std::size_t n,
+               unsigned threads);
+    void release(bool unlink);
+
+    std::string name_;
+    void *base_;
+    std::size_t bytes_;
+    uint64_t published_;
+};
+
+// Read-only mapping of a segment; throws std::runtime_error if it cannot be opened
+// or is not a compatible segment
+class SharedReader {
+public:
+    explicit SharedReader(const std::string &name);
+    ~SharedReader();
+    SharedReader(const SharedReader &) = delete;
+    SharedReader &operator=(const SharedReader &) = delete;
+
+    const SharedHeader &header() const { return *static_cast<const SharedHeader *>(base_); }
+    const uint8_t *base() const { return static_cast<const uint8_t *>(base_); }
+    std::size_t bytes() const { return bytes_; }
+
+    // Latest complete publication (0 = none yet)
+    uint64_t published() const { return header().published.load(std::memory_order_acquire); }
+    bool retired() const { return header().retired.load(std::memory_order_acquire) != 0; }
+    // True if publication `seq` was not overwritten before this call; call it after
+    // reading the slot to validate what was read
+    bool intact(uint64_t seq) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return header().writing.load(std::memory_order_relaxed) < seq + 2;
+    }
+    // Slot of publication `seq` and one of its columns
+    const SharedSlot &slot(uint64_t seq) const { return header().slots[seq & 1]; }
+    std::size_t column_offset(uint64_t seq, SharedColumn c) const {
+        return header().data_offset + (seq & 1) * header().slot_bytes + header().column_offset[(int)c];
+    }
+
+private:
+    void *base_;
+    std::size_t bytes_;
+};
+
+// POSIX shared-memory names start with a single '/'
+std::string shared_segment_name(const std::string &name);
+
+} // namespace popsim
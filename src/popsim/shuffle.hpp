@@ -0,0 +1,80 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include "parallel.hpp"
+#include "scratch_arena.hpp"
+
+namespace popsim {
+
+// Uniform random permutation of v that depends only on (seed, v), never on the
+// thread count. Small inputs get a plain Fisher-Yates pass. Larger inputs use
+// Rao-Sandelius: every element is sent to one of B buckets by a per-chunk
+// stream, buckets are concatenated in order, and each bucket is Fisher-Yates
+// shuffled with its own stream. Chunks and buckets are fixed by n, so threads
+// only decide who does the work. Temporaries live in `arena`, which must not
+// be touched by the caller while this runs.
+template <class T>
+void parallel_shuffle(ScratchVector<T> &v, uint64_t seed, unsigned threads, ScratchArena &arena,
+                      Tracer *tracer = nullptr) {
+    constexpr std::size_t kChunk = std::size_t(1) << 16; // elements per scatter chunk
+    constexpr unsigned kMaxBucketBits = 8;
+    const std::size_t n = v.size();
+
+    auto fisher_yates = [](T *first, std::size_t len, uint64_t stream_seed) {
+        SplitMix64 g(stream_seed);
+        for (std::size_t i = len; i > 1; --i) std::swap(first[i - 1], first[g.below(i)]);
+    };
+    if (n < 2 * kChunk) {
+        fisher_yates(v.data(), n, derive_seed(seed, 0));
+        return;
+    }
+
+    unsigned bucket_bits = 1;
+    while (bucket_bits < kMaxBucketBits && (std::size_t(1) << bucket_bits) * kChunk < n) ++bucket_bits;
+    const std::size_t buckets = std::size_t(1) << bucket_bits;
+    const std::size_t chunks = (n + kChunk - 1) / kChunk;
+
+    ScratchVector<uint8_t> bucket_of(n, ArenaAllocator<uint8_t>(arena));
+    ScratchVector<std::size_t> offset(chunks * buckets, 0, ArenaAllocator<std::size_t>(arena)); // [chunk][bucket]
+    ScratchVector<std::size_t> bucket_start(buckets + 1, 0, ArenaAllocator<std::size_t>(arena));
+    ScratchVector<T> out(n, ArenaAllocator<T>(arena));
+
+    // 1) pick a bucket for every element, counting per chunk
+    parallel_for(chunks, threads, [&](std::size_t c) {
+        SplitMix64 g(derive_seed(seed, 1 + c));
+        std::size_t *count = &offset[c * buckets];
+        const std::size_t end = std::min(n, (c + 1) * kChunk);
+        for (std::size_t i = c * kChunk; i < end; ++i) {
+            uint8_t b = (uint8_t)(g() >> (64 - bucket_bits));
+            bucket_of[i] = b;
+            ++count[b];
+        }
+    }, tracer, "shuffle: bucket");
+    // 2) exclusive prefix sum, bucket-major then chunk, so the scatter is stable
+    std::size_t pos = 0;
+    for (std::size_t b = 0; b < buckets; ++b) {
+        bucket_start[b] = pos;
+        for (std::size_t c = 0; c < chunks; ++c) {
+            std::size_t cnt = offset[c * buckets + b];
+            offset[c * buckets + b] = pos;
+            pos += cnt;
+        }
+    }
+    bucket_start[buckets] = pos;
+    // 3) scatter
+    parallel_for(chunks, threads, [&](std::size_t c) {
+        std::size_t *next = &offset[c * buckets];
+        const std::size_t end = std::min(n, (c + 1) * kChunk);
+        for (std::size_t i = c * kChunk; i < end; ++i) out[next[bucket_of[i]]++] = v[i];
+    }, tracer, "shuffle: scatter");
+    // 4) shuffle every bucket independently
+    parallel_for(buckets, threads, [&](std::size_t b) {
+        fisher_yates(out.data() + bucket_start[b], bucket_start[b + 1] - bucket_start[b],
+                     derive_seed(seed, 1 + chunks + b));
+    }, tracer, "shuffle: permute");
+    v.swap(out);
+}
+
+} // namespace popsim
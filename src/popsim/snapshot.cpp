@@ -0,0 +1,41 @@
+#include "population.hpp"
+
+namespace popsim {
+
+// Buffers kept for reuse: the latest, the one being filled, and one a slow reader holds.
+// Beyond that, buffers still held by readers are freed when the readers let go.
+static constexpr std::size_t kMaxPooledSnapshots = 3;
+
+void SnapshotPublisher::publish(int32_t year, std::size_t births, std::size_t deaths, const Person *people,
+                                std::size_t n) {
+    // A pooled buffer that is not the latest and has no other owner cannot gain one:
+    // readers only ever copy latest_, under the lock
+    std::shared_ptr<PopulationSnapshot> target;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto &b : pool_) {
+            if (b != latest_ && b.use_count() == 1) {
+                target = b;
+                break;
+            }
+        }
+    }
+    if (!target) {
+        target = std::make_shared<PopulationSnapshot>();
+        if (pool_.size() < kMaxPooledSnapshots) pool_.push_back(target);
+    }
+    target->epoch = ++epoch_;
+    target->year = year;
+    target->births = births;
+    target->deaths = deaths;
+    target->people.assign(people, people + n);
+    std::lock_guard<std::mutex> lock(mutex_);
+    latest_ = std::move(target);
+}
+
+std::shared_ptr<const PopulationSnapshot> SnapshotPublisher::latest() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return latest_;
+}
+
+} // namespace popsim
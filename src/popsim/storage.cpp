@@ -0,0 +1,64 @@
+#include "storage.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace popsim {
+
+void *storage_allocate(std::size_t bytes, bool huge_pages) {
+    if (bytes == 0) bytes = 1;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (huge_pages && bytes >= kHugePageSize) {
+        std::size_t rounded = (bytes + kHugePageSize - 1) & ~(kHugePageSize - 1);
+        void *p = std::aligned_alloc(kHugePageSize, rounded);
+        if (p) {
+            // advisory: if THP is disabled the block simply stays on 4 KB pages
+            madvise(p, rounded, MADV_HUGEPAGE);
+            return p;
+        }
+        // fall through to ordinary pages
+    }
+#else
+    (void)huge_pages;
+#endif
+    void *p = std::malloc(bytes);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void storage_free(void *p) { std::free(p); }
+
+std::size_t huge_page_bytes(const void *p, std::size_t bytes) {
+#if defined(__linux__)
+    if (!p || bytes == 0) return 0;
+    std::FILE *f = std::fopen("/proc/self/smaps", "r");
+    if (!f) return 0;
+    const uintptr_t lo = (uintptr_t)p, hi = lo + bytes;
+    std::size_t total = 0;
+    bool in_range = false;
+    char line[512];
+    while (std::fgets(line, sizeof(line), f)) {
+        unsigned long start, end;
+        if (std::sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            // mapping header: overlapping VMAs contribute their AnonHugePages
+            in_range = start < hi && end > lo;
+            continue;
+        }
+        unsigned long kb;
+        if (in_range && std::sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) total += (std::size_t)kb * 1024;
+    }
+    std::fclose(f);
+    return total < bytes ? total : bytes;
+#else
+    (void)p;
+    (void)bytes;
+    return 0;
+#endif
+}
+
+} // namespace popsim
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <type_traits>
+
+namespace popsim {
+
+// Raw storage for the population arrays. With huge_pages set, blocks of at
+// least kHugePageSize are 2 MB aligned and advised for transparent huge pages
+// (Linux only); otherwise, or if the kernel refuses, they are ordinary pages.
+// Every block is released with storage_free regardless of how it was obtained.
+constexpr std::size_t kHugePageSize = std::size_t(2) << 20;
+void *storage_allocate(std::size_t bytes, bool huge_pages);
+void storage_free(void *p);
+
+// Bytes of [p, p + bytes) currently backed by huge pages, from /proc/self/smaps
+// (0 where unsupported)
+std::size_t huge_page_bytes(const void *p, std::size_t bytes);
+
+// Allocator for the population vectors. The huge-page flag travels with the
+// container on swap/move, and any instance can free any block, so all
+// instances compare equal.
+template <class T>
+struct PopulationAllocator {
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    PopulationAllocator() : huge_pages(false) {}
+    explicit PopulationAllocator(bool huge) : huge_pages(huge) {}
+    template <class U>
+    PopulationAllocator(const PopulationAllocator<U> &other) : huge_pages(other.huge_pages) {}
+
+    T *allocate(std::size_t n) { return static_cast<T *>(storage_allocate(n * sizeof(T), huge_pages)); }
+    void deallocate(T *p, std::size_t) { storage_free(p); }
+
+    template <class U>
+    bool operator==(const PopulationAllocator<U> &) const { return true; }
+    template <class U>
+    bool operator!=(const PopulationAllocator<U> &) const { return false; }
+
+    bool huge_pages;
+};
+
+} // namespace popsim
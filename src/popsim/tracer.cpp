@@ -0,0 +1,52 @@
+#include "tracer.hpp"
+#include <cstdio>
+#include <stdexcept>
+
+namespace popsim {
+
+Tracer::Tracer(std::size_t events_per_worker)
+    : origin_(Clock::now()), capacity_(events_per_worker), year_(0) {
+    reserve_workers(1);
+}
+
+void Tracer::reserve_workers(std::size_t workers) {
+    while (buffers_.size() < workers) {
+        auto b = std::make_unique<Buffer>();
+        b->events.resize(capacity_);
+        buffers_.push_back(std::move(b));
+    }
+}
+
+std::size_t Tracer::dropped() const {
+    std::size_t n = 0;
+    for (const auto &b : buffers_) n += b->dropped;
+    return n;
+}
+
+void Tracer::write_chrome_trace(const std::string &path) const {
+    std::FILE *f = std::fopen(path.c_str(), "w");
+    if (!f) throw std::runtime_error("cannot open trace file for writing: " + path);
+    std::fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (std::size_t w = 0; w < buffers_.size(); ++w) {
+        if (w == 0) {
+            std::fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+                            "\"args\":{\"name\":\"step\"}}");
+        } else {
+            std::fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,"
+                            "\"args\":{\"name\":\"worker %zu\"}}",
+                         w, w);
+        }
+        const Buffer &b = *buffers_[w];
+        for (std::size_t i = 0; i < b.size; ++i) {
+            const Event &e = b.events[i];
+            // Chrome trace timestamps are microseconds
+            std::fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f,"
+                            "\"args\":{\"year\":%d}}",
+                         e.name, w, (double)e.start_ns / 1000.0, (double)e.dur_ns / 1000.0, (int)e.year);
+        }
+    }
+    std::fprintf(f, "\n]}\n");
+    if (std::fclose(f) != 0) throw std::runtime_error("failed writing trace file: " + path);
+}
+
+} // namespace popsim
@@ -0,0 +1,81 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace popsim {
+
+// Lightweight timeline tracer. Each worker slot (0 = the thread driving step())
+// owns a fixed-size event buffer that only it writes, so recording is lock-free.
+// Slots are created by the driving thread before workers start; buffers are read
+// only after the workers have joined. Full buffers drop further events and count
+// them. write_chrome_trace produces JSON for chrome://tracing or ui.perfetto.dev.
+class Tracer {
+public:
+    struct Event {
+        const char *name; // static string
+        uint64_t start_ns;
+        uint64_t dur_ns;
+        int32_t year;
+    };
+
+    explicit Tracer(std::size_t events_per_worker);
+
+    // Make sure slots [0, workers) exist; driving thread only
+    void reserve_workers(std::size_t workers);
+    uint64_t now_ns() const {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - origin_).count();
+    }
+    void record(std::size_t worker, const char *name, uint64_t start_ns, int32_t year) {
+        Buffer &b = *buffers_[worker];
+        if (b.size == b.events.size()) {
+            ++b.dropped;
+            return;
+        }
+        b.events[b.size++] = Event{name, start_ns, now_ns() - start_ns, year};
+    }
+
+    // Year attached to events; set by the driving thread
+    void set_year(int32_t year) { year_ = year; }
+    int32_t year() const { return year_; }
+
+    std::size_t dropped() const;
+    // Throws std::runtime_error if the file cannot be written
+    void write_chrome_trace(const std::string &path) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Buffer {
+        std::vector<Event> events;
+        std::size_t size = 0;
+        std::size_t dropped = 0;
+    };
+
+    Clock::time_point origin_;
+    std::size_t capacity_;
+    int32_t year_;
+    std::vector<std::unique_ptr<Buffer>> buffers_;
+};
+
+// Times a scope on one worker slot; inert when tracer is null
+class TraceScope {
+public:
+    TraceScope(Tracer *tracer, std::size_t worker, const char *name)
+        : tracer_(tracer), worker_(worker), name_(name), start_(tracer ? tracer->now_ns() : 0) {}
+    ~TraceScope() {
+        if (tracer_) tracer_->record(worker_, name_, start_, tracer_->year());
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    Tracer *tracer_;
+    std::size_t worker_;
+    const char *name_;
+    uint64_t start_;
+};
+
+} // namespace popsim
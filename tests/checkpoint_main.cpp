@@ -0,0 +1,64 @@
+// Rejected checkpoints leave the population untouched: every truncated prefix of a
+// serialized state (both formats) must throw from deserialize(), after which the
+// target steps exactly like an untouched copy. Exits non-zero on any failure.
+//
+//   make check                  # also runs build/checkpoint
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "differential.hpp"
+
+using namespace popsim;
+
+namespace {
+
+void run(Population &p, const Environment &env, std::size_t n, uint32_t years) {
+    p.set_environment(env);
+    p.set_metrics_level(MetricsLevel::Hash);
+    p.initialize_random(n);
+    p.step(years);
+}
+
+} // namespace
+
+int main() {
+    std::mt19937_64 rng(2024);
+    const Environment env = random_environment(rng, 2000);
+    int failures = 0;
+    for (CheckpointFormat format : {CheckpointFormat::Raw, CheckpointFormat::Compressed}) {
+        std::vector<char> state;
+        Population source(1);
+        run(source, env, 600, 4);
+        source.serialize(state, format);
+
+        Population target(2), reference(2);
+        run(target, env, 2000, 12);
+        run(reference, env, 2000, 12);
+        target.reorder_households();
+        reference.reorder_households();
+        std::size_t rejected = 0;
+        // every prefix near the ends, a stride through the middle
+        for (std::size_t len = 0; len < state.size(); len += (len < 256 || state.size() - len < 256) ? 1 : 97) {
+            try {
+                target.deserialize(state.data(), len);
+            } catch (const std::exception &) {
+                ++rejected;
+                continue;
+            }
+            std::printf("FAIL  %s prefix of %zu bytes was accepted\n",
+                        format == CheckpointFormat::Raw ? "raw" : "compressed", len);
+            ++failures;
+            break;
+        }
+        target.step(10);
+        reference.step(10);
+        const bool same = target.state_hash_history() == reference.state_hash_history() &&
+                          target.persons().size() == reference.persons().size();
+        std::printf("%s  %-10s %zu truncated states rejected, target %s\n", same ? "PASS" : "FAIL",
+                    format == CheckpointFormat::Raw ? "raw" : "compressed", rejected,
+                    same ? "unchanged" : "modified");
+        if (!same) ++failures;
+    }
+    return failures ? 1 : 0;
+}
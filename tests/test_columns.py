@@ -0,0 +1,49 @@
+"""Column export bookkeeping; run with `python tests/test_columns.py` or pytest
+against a built extension."""
+import gc
+
+import numpy as np
+from popsim import Environment, Population
+
+
+def make_population():
+    env = Environment()
+    env.resources = 3000.0
+    env.marriage_probability = 0.9
+    env.conceiving_probability = 0.8
+    curve = np.full(128, 0.01, dtype=np.float32)
+    curve[100:] = 0.9
+    env.dying_curve = curve
+    pop = Population(seed=7)
+    pop.set_environment(env)
+    pop.initialize_random(1000, 60)
+    return pop
+
+
+def test_column_blocks_step_until_released():
+    pop = make_population()
+    col = pop.column("id")
+    try:
+        pop.step(1)
+    except BufferError:
+        pass
+    else:
+        raise AssertionError("step() ran with a column exported")
+    del col
+    assert pop.step(1) == 1
+
+
+def test_column_freed_in_reference_cycle():
+    pop = make_population()
+    cycle = [pop.column("birth_year")]
+    cycle.append(cycle)
+    del cycle
+    gc.collect()
+    assert pop.step(1) == 1
+
+
+if __name__ == "__main__":
+    for name, fn in list(globals().items()):
+        if name.startswith("test_"):
+            fn()
+            print("PASS ", name)